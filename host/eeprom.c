@@ -0,0 +1,115 @@
+/**
+ * @file eeprom.c
+ * @brief RAM backed stand-in for the EEPROM emulator on the host
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#include "utils/eeprom.h"
+
+static uint8_t host_eeprom[HOST_EEPROM_PAGES][EEPROM_PAGE_SIZE];
+static bool host_eeprom_initialized = false;
+uint32_t host_eeprom_writes = 0;
+
+//-----------------------------------------------------------------------------
+enum status_code eeprom_emulator_init(void)
+{
+  if (!host_eeprom_initialized) {
+    eeprom_emulator_erase_memory();
+  }
+  return STATUS_OK;
+}
+
+//-----------------------------------------------------------------------------
+void eeprom_emulator_erase_memory(void)
+{
+  memset(host_eeprom, 0xFF, sizeof(host_eeprom));
+  host_eeprom_initialized = true;
+  host_eeprom_writes = 0;
+}
+
+//-----------------------------------------------------------------------------
+enum status_code eeprom_emulator_get_parameters(
+    struct eeprom_emulator_parameters *const parameters)
+{
+  if (!host_eeprom_initialized) {
+    return STATUS_ERR_NOT_INITIALIZED;
+  }
+  parameters->page_size = EEPROM_PAGE_SIZE;
+  parameters->eeprom_number_of_pages = HOST_EEPROM_PAGES;
+  return STATUS_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Pages are written directly, there is no page buffer
+enum status_code eeprom_emulator_commit_page_buffer(void)
+{
+  return STATUS_OK;
+}
+
+//-----------------------------------------------------------------------------
+enum status_code eeprom_emulator_write_page(
+    const uint8_t logical_page,
+    const uint8_t *const data)
+{
+  if (!host_eeprom_initialized) {
+    return STATUS_ERR_NOT_INITIALIZED;
+  }
+  if (logical_page >= HOST_EEPROM_PAGES) {
+    return STATUS_ERR_BAD_ADDRESS;
+  }
+  memcpy(host_eeprom[logical_page], data, EEPROM_PAGE_SIZE);
+  host_eeprom_writes++;
+  return STATUS_OK;
+}
+
+//-----------------------------------------------------------------------------
+enum status_code eeprom_emulator_read_page(
+    const uint8_t logical_page,
+    uint8_t *const data)
+{
+  if (!host_eeprom_initialized) {
+    return STATUS_ERR_NOT_INITIALIZED;
+  }
+  if (logical_page >= HOST_EEPROM_PAGES) {
+    return STATUS_ERR_BAD_ADDRESS;
+  }
+  memcpy(data, host_eeprom[logical_page], EEPROM_PAGE_SIZE);
+  return STATUS_OK;
+}
+
+//-----------------------------------------------------------------------------
+enum status_code eeprom_emulator_write_buffer(
+    const uint16_t offset,
+    const uint8_t *const data,
+    const uint16_t length)
+{
+  if (!host_eeprom_initialized) {
+    return STATUS_ERR_NOT_INITIALIZED;
+  }
+  if (offset + length > sizeof(host_eeprom)) {
+    return STATUS_ERR_BAD_ADDRESS;
+  }
+  memcpy(&host_eeprom[0][0] + offset, data, length);
+  host_eeprom_writes++;
+  return STATUS_OK;
+}
+
+//-----------------------------------------------------------------------------
+enum status_code eeprom_emulator_read_buffer(
+    const uint16_t offset,
+    uint8_t *const data,
+    const uint16_t length)
+{
+  if (!host_eeprom_initialized) {
+    return STATUS_ERR_NOT_INITIALIZED;
+  }
+  if (offset + length > sizeof(host_eeprom)) {
+    return STATUS_ERR_BAD_ADDRESS;
+  }
+  memcpy(data, &host_eeprom[0][0] + offset, length);
+  return STATUS_OK;
+}
@@ -0,0 +1,224 @@
+/**
+ * @file hal.c
+ * @brief Virtual hardware for the loconet core on the host
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#include "hal.h"
+#include "components/fast_clock.h"
+#include "loconet/loconet_fault.h"
+#include "utils/memory.h"
+#include "utils/timer.h"
+
+uint32_t host_primask = 0;
+SysTick_Type host_systick = { 0, TIMER_TICKS_PER_MS - 1, TIMER_TICKS_PER_MS - 1, 0 };
+SCB_Type host_scb = { 0 };
+Pm host_pm;
+Gclk host_gclk;
+
+HOST_HAL_Type host_hal;
+volatile LOCONET_IRQ_STATS_Type loconet_irq_stats = { 0, 0, 0 };
+
+//-----------------------------------------------------------------------------
+// Timer, without SysTick the milliseconds only change by host_time_advance
+volatile uint32_t timer_milliseconds = 0;
+
+void timer_init(void)
+{
+  timer_milliseconds = 0;
+}
+
+void host_time_advance(uint32_t ms)
+{
+  timer_milliseconds += ms;
+}
+
+//-----------------------------------------------------------------------------
+// Replaces LOCONET_BUILD
+void loconet_init(void)
+{
+  loconet_status.reg |= LOCONET_STATUS_BUSY;
+  host_hal.receive = 1;
+  loconet_rx_init();
+}
+
+//-----------------------------------------------------------------------------
+// Hardware actions of loconet_hw.c
+void loconet_flank_timer_delay(uint16_t delay_us)
+{
+  host_hal.delay = delay_us;
+}
+
+void loconet_hw_enable_rx_tx(void)
+{
+  host_hal.tx_high = 0;
+  host_hal.receive = 1;
+}
+
+void loconet_hw_disable_rx_tx(void)
+{
+  host_hal.receive = 0;
+}
+
+void loconet_hw_force_tx_high(void)
+{
+  host_hal.tx_high = 1;
+}
+
+void loconet_hw_enable_transmit(void)
+{
+  host_hal.transmit = 1;
+  loconet_activity_led_on();
+}
+
+void loconet_activity_led_on(void)
+{
+  host_hal.led = 1;
+}
+
+void loconet_activity_led_off(void)
+{
+  host_hal.led = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Receive side of loconet_irq_sercom
+void host_uart_receive(uint8_t byte)
+{
+  if (!host_hal.receive) {
+    return;
+  }
+  loconet_irq_stats.sercom++;
+
+  if (loconet_status.bit.COLLISION_DETECTED) {
+    // Ignore byte
+  } else if (loconet_status.bit.TRANSMIT) {
+    // Read own bytes to see if we have a collision
+    if (byte ^ loconet_tx_next_rx_byte()) {
+      loconet_irq_collision();
+    }
+  } else {
+    loconet_rx_buffer_push(byte);
+  }
+}
+
+//-----------------------------------------------------------------------------
+void host_uart_framing_error(void)
+{
+  if (!host_hal.receive) {
+    return;
+  }
+  loconet_irq_stats.sercom++;
+
+  if (!loconet_status.bit.COLLISION_DETECTED) {
+    loconet_stats.framing++;
+    loconet_irq_collision();
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Transmit side of loconet_irq_sercom, ends with transmit complete
+uint8_t host_uart_transmit(uint8_t *data, uint8_t size)
+{
+  uint8_t sent = 0;
+
+  while (host_hal.transmit) {
+    if (loconet_status.bit.COLLISION_DETECTED || !loconet_status.bit.TRANSMIT) {
+      loconet_status.bit.TRANSMIT = 0;
+      host_hal.transmit = 0;
+    } else if (loconet_tx_finished()) {
+      loconet_status.bit.TRANSMIT = 0;
+      host_hal.transmit = 0;
+    } else {
+      uint8_t byte = loconet_tx_next_tx_byte();
+      if (sent < size) {
+        data[sent] = byte;
+      }
+      sent++;
+      host_uart_receive(byte);
+    }
+  }
+
+  if (sent) {
+    loconet_tx_stop();
+    loconet_activity_led_off();
+  }
+  return sent < size ? sent : size;
+}
+
+//-----------------------------------------------------------------------------
+// Flank interrupt without the event system
+void host_flank(uint8_t level)
+{
+  loconet_irq_stats.flank++;
+  if (level) {
+    loconet_irq_flank_rise();
+  } else {
+    loconet_irq_flank_fall();
+  }
+}
+
+//-----------------------------------------------------------------------------
+uint8_t host_timer_expire(void)
+{
+  if (!host_hal.delay) {
+    return 0;
+  }
+  loconet_irq_stats.timer++;
+  // The timer is disabled before loconet_irq_timer, which can start it again
+  host_hal.delay = 0;
+  loconet_irq_timer();
+  return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Replaces FAST_CLOCK_BUILD
+#ifdef COMPONENTS_FAST_CLOCK
+static Tc host_fast_clock_timer;
+
+void fast_clock_init(void)
+{
+  fast_clock_init_timer(&host_fast_clock_timer, 0, 0, 0);
+  fast_clock_init_rx();
+}
+
+void host_fast_clock_tick(void)
+{
+  fast_clock_irq();
+}
+#else
+void host_fast_clock_tick(void)
+{
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// There is no painted stack or hard fault record on the host
+uint16_t memory_stack_size(void)
+{
+  return 0;
+}
+
+uint16_t memory_stack_used(void)
+{
+  return 0;
+}
+
+uint16_t memory_heap_size(void)
+{
+  return 0;
+}
+
+uint16_t memory_heap_used(void)
+{
+  return 0;
+}
+
+uint16_t loconet_fault_cv(uint16_t index)
+{
+  return index == 0 ? 0 : 0xFFFF;
+}
@@ -0,0 +1,74 @@
+/**
+ * @file hal.h
+ * @brief Virtual hardware for the loconet core on the host
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * `make host` builds the loconet core for the workstation into
+ * build/host/libloconet.a. This file replaces loconet_hw.c, the SysTick
+ * timer and the hard fault and memory reports; utils/eeprom.h is replaced
+ * by a RAM backed version. A test or benchmark drives the core like the
+ * interrupts on the chip do, see smoke.c (`make host-check`):
+ *
+ *     eeprom_emulator_init();
+ *     loconet_cv_init();
+ *     loconet_init();
+ *     host_flank(0);               // Bus activity, carrier detect starts
+ *     host_uart_receive(0xB2);     // A byte from the bus
+ *     host_flank(1);
+ *     ...
+ *     while (host_timer_expire()); // Carrier detect, master and priority
+ *                                  // delays end one by one
+ *     loconet_rx_process();
+ *
+ * Messages sent by the module are collected with `host_uart_transmit`,
+ * which also echoes them on the receive side like the bus does.
+ *
+ * Only the default flank detection is modelled, not LOCONET_FLANK_EVSYS.
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#ifndef _HOST_HAL_H_
+#define _HOST_HAL_H_
+
+#include <stdint.h>
+#include "loconet/loconet.h"
+
+//-----------------------------------------------------------------------------
+// State of the virtual hardware
+typedef struct {
+  uint8_t receive;   // Usart receives (RXEN)
+  uint8_t transmit;  // Data register empty interrupt is enabled
+  uint8_t tx_high;   // TX pin forced high for a line break
+  uint8_t led;       // Activity led
+  uint16_t delay;    // Running flank timer delay (us), 0 when stopped
+} HOST_HAL_Type;
+
+extern HOST_HAL_Type host_hal;
+
+//-----------------------------------------------------------------------------
+// Advance the millisecond timer
+extern void host_time_advance(uint32_t ms);
+
+//-----------------------------------------------------------------------------
+// A byte arrives on the usart
+extern void host_uart_receive(uint8_t byte);
+// A byte arrives with a framing error (line break on the bus)
+extern void host_uart_framing_error(void);
+// Send the bytes the module transmits, at most size are written to data.
+// Every byte is received back like on the bus. Returns the number sent.
+extern uint8_t host_uart_transmit(uint8_t *data, uint8_t size);
+
+//-----------------------------------------------------------------------------
+// A rising (1) or falling (0) flank on the flank pin
+extern void host_flank(uint8_t level);
+// The running flank timer delay has passed, returns 0 if none was running
+extern uint8_t host_timer_expire(void);
+
+//-----------------------------------------------------------------------------
+// Tick of the 50 ms fast clock timer
+extern void host_fast_clock_tick(void);
+
+#endif // _HOST_HAL_H_
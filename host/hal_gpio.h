@@ -0,0 +1,19 @@
+/**
+ * @file hal_gpio.h
+ * @brief Stand-in for the GPIO macros when building on the host
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * LOCONET_BUILD and LOGGER_BUILD are not used on the host, so no pins are
+ * defined.
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#ifndef _HOST_HAL_GPIO_H_
+#define _HOST_HAL_GPIO_H_
+
+#define HAL_GPIO_PIN(...)
+
+#endif // _HOST_HAL_GPIO_H_
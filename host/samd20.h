@@ -0,0 +1,124 @@
+/**
+ * @file samd20.h
+ * @brief Stand-in for the device header when building on the host
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * Only provides what the loconet core uses outside of loconet_hw.c. The
+ * interrupt mask is a variable and the SysTick counter follows the
+ * milliseconds of host_time_advance (see hal.h).
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#ifndef _HOST_SAMD20_H_
+#define _HOST_SAMD20_H_
+
+#include <stdint.h>
+
+#ifndef F_CPU
+#define F_CPU 8000000
+#endif
+
+//-----------------------------------------------------------------------------
+// Registers are plain memory, only the registers used outside the hardware
+// files (loconet_hw.c, loconet_fault.c) are modelled
+typedef struct {
+  uint32_t reg;
+} HOST_REG_Type;
+
+typedef struct {
+  volatile HOST_REG_Type CTRLA;
+  volatile HOST_REG_Type INTENSET;
+  volatile HOST_REG_Type INTFLAG;
+  volatile HOST_REG_Type COUNT;
+  volatile HOST_REG_Type CC[2];
+} TcCount16;
+
+typedef struct host_tc {
+  TcCount16 COUNT16;
+} Tc;
+
+typedef struct {
+  volatile HOST_REG_Type APBCMASK;
+} Pm;
+
+typedef struct {
+  volatile HOST_REG_Type CLKCTRL;
+} Gclk;
+
+// Only appear as pointers in prototypes
+typedef struct host_sercom Sercom;
+typedef struct host_port_group PortGroup;
+
+extern Pm host_pm;
+extern Gclk host_gclk;
+
+#define PM (&host_pm)
+#define GCLK (&host_gclk)
+
+#define GCLK_CLKCTRL_ID(value)      ((value) & 0x3Ful)
+#define GCLK_CLKCTRL_GEN(value)     (((value) << 8) & 0xF00ul)
+#define GCLK_CLKCTRL_CLKEN          (0x1ul << 14)
+
+#define TC_CTRLA_ENABLE             (0x1ul << 1)
+#define TC_CTRLA_MODE_COUNT16       (0x0ul << 2)
+#define TC_CTRLA_WAVEGEN_MFRQ       (0x1ul << 5)
+#define TC_CTRLA_PRESCALER_DIV8     (0x3ul << 8)
+#define TC_CTRLA_PRESCSYNC_RESYNC   (0x1ul << 12)
+#define TC_INTENSET_MC(value)       (((value) << 4) & 0x30ul)
+#define TC_INTFLAG_MC(value)        (((value) << 4) & 0x30ul)
+
+#define NVIC_EnableIRQ(irqn) do { (void)(irqn); } while (0)
+
+//-----------------------------------------------------------------------------
+// Interrupts, there is no concurrency on the host
+extern uint32_t host_primask;
+
+static inline uint32_t __get_PRIMASK(void)
+{
+  return host_primask;
+}
+
+static inline void __set_PRIMASK(uint32_t primask)
+{
+  host_primask = primask;
+}
+
+static inline void __disable_irq(void)
+{
+  host_primask = 1;
+}
+
+static inline void __enable_irq(void)
+{
+  host_primask = 0;
+}
+
+#define __DSB() do {} while (0)
+#define __DMB() do {} while (0)
+#define __NOP() do {} while (0)
+
+//-----------------------------------------------------------------------------
+// SysTick, read by timer_cycles
+typedef struct {
+  volatile uint32_t CTRL;
+  volatile uint32_t LOAD;
+  volatile uint32_t VAL;
+  volatile uint32_t CALIB;
+} SysTick_Type;
+
+typedef struct {
+  volatile uint32_t ICSR;
+} SCB_Type;
+
+#define SCB_ICSR_PENDSTSET_Msk (1ul << 26)
+
+extern SysTick_Type host_systick;
+extern SCB_Type host_scb;
+
+#define SysTick (&host_systick)
+#define SCB (&host_scb)
+
+#endif // _HOST_SAMD20_H_
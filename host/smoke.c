@@ -0,0 +1,152 @@
+/**
+ * @file smoke.c
+ * @brief Smoke test of the host build of the loconet core
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * Drives the core through the virtual hardware of hal.h: a sensor report
+ * is received, a switch request is sent and read back from the bus and an
+ * LNCV is read. Built and run by `make host-check`, it returns 0 when all
+ * checks pass.
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#include <stdio.h>
+#include "hal.h"
+#include "loconet/loconet_cv.h"
+#include "loconet/loconet_rx.h"
+#include "loconet/loconet_tx.h"
+#include "utils/eeprom.h"
+
+static uint8_t smoke_failed = 0;
+
+#define SMOKE_CHECK(condition)                                                \
+  do {                                                                        \
+    if (!(condition)) {                                                       \
+      printf("%s:%d: %s failed\n", __FILE__, __LINE__, #condition);           \
+      smoke_failed = 1;                                                       \
+    }                                                                         \
+  } while (0)
+
+//-----------------------------------------------------------------------------
+// Prototypes
+void loconet_rx_input_rep(uint8_t, uint8_t);
+void loconet_rx_sw_req(uint8_t, uint8_t);
+
+//-----------------------------------------------------------------------------
+// Last sensor report and switch request handled
+static uint16_t smoke_input_rep = 0;
+static uint16_t smoke_sw_req = 0;
+#ifdef LOCONET_TX_ECHO
+static uint8_t smoke_sw_req_local = 0;
+#endif
+
+void loconet_rx_input_rep(uint8_t in1, uint8_t in2)
+{
+  smoke_input_rep = (in2 << 8) | in1;
+}
+
+void loconet_rx_sw_req(uint8_t sw1, uint8_t sw2)
+{
+  smoke_sw_req = (sw2 << 8) | sw1;
+#ifdef LOCONET_TX_ECHO
+  smoke_sw_req_local = loconet_rx_is_local();
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Wait until carrier detect, master and priority delay have passed
+static void smoke_idle(void)
+{
+  while (host_timer_expire());
+}
+
+//-----------------------------------------------------------------------------
+// A message from another node arrives
+static void smoke_receive(const uint8_t *message, uint8_t length)
+{
+  for (uint8_t index = 0; index < length; index++) {
+    host_flank(0);
+    host_uart_receive(message[index]);
+    host_flank(1);
+  }
+  smoke_idle();
+}
+
+//-----------------------------------------------------------------------------
+static void smoke_sensor_report(void)
+{
+  uint8_t message[4] = { 0xB2, 0x12, 0x34, 0 };
+  message[3] = loconet_calc_checksum(message, 3);
+
+  smoke_receive(message, sizeof(message));
+  while (loconet_rx_process());
+
+  SMOKE_CHECK(smoke_input_rep == 0x3412);
+  SMOKE_CHECK(!loconet_status.bit.BUSY);
+}
+
+//-----------------------------------------------------------------------------
+static void smoke_switch_request(void)
+{
+  uint8_t sent[8];
+  uint16_t transmitted = loconet_tx_stats.transmitted;
+
+  SMOKE_CHECK(loconet_tx_queue_4(0xB0, 1, 0x01, 0x20) == STATUS_OK);
+  loconet_tx_process();
+  uint8_t length = host_uart_transmit(sent, sizeof(sent));
+
+  // Every byte was read back from the bus without a collision
+  SMOKE_CHECK(length == 4);
+  SMOKE_CHECK(sent[0] == 0xB0 && sent[1] == 0x01 && sent[2] == 0x20);
+  SMOKE_CHECK(sent[3] == loconet_calc_checksum(sent, 3));
+  SMOKE_CHECK(loconet_tx_stats.transmitted == transmitted + 1);
+  SMOKE_CHECK(loconet_stats.collisions == 0);
+  SMOKE_CHECK(loconet_tx_queue_size() == 0);
+
+#ifdef LOCONET_TX_ECHO
+  // The request is handled as if it was received
+  loconet_tx_process();
+  SMOKE_CHECK(smoke_sw_req == 0x2001);
+  SMOKE_CHECK(smoke_sw_req_local);
+#else
+  // Messages of the module are not handled
+  while (loconet_rx_process());
+  SMOKE_CHECK(smoke_sw_req == 0);
+#endif
+  smoke_idle();
+}
+
+//-----------------------------------------------------------------------------
+static void smoke_lncv(void)
+{
+  // Not configured yet, the initial values are read
+  SMOKE_CHECK(loconet_cv_get(0) == LOCONET_CV_INITIAL_ADDRESS);
+  SMOKE_CHECK(loconet_cv_get(2) == LOCONET_CV_INITIAL_PRIORITY);
+  // Statistics are read-only LNCVs
+  SMOKE_CHECK(loconet_cv_get(LOCONET_CV_STATS + 4) == loconet_rx_stats.received);
+  SMOKE_CHECK(loconet_cv_get(LOCONET_CV_STATS + 8) == loconet_tx_stats.transmitted);
+}
+
+//-----------------------------------------------------------------------------
+int main(void)
+{
+  eeprom_emulator_init();
+  SMOKE_CHECK(loconet_cv_init() == STATUS_OK);
+  loconet_init();
+
+  // Bus activity, then the line becomes idle
+  host_flank(0);
+  host_flank(1);
+  smoke_idle();
+
+  smoke_sensor_report();
+  smoke_switch_request();
+  smoke_lncv();
+  host_fast_clock_tick();
+
+  printf("%s\n", smoke_failed ? "Smoke test failed" : "Smoke test passed");
+  return smoke_failed;
+}
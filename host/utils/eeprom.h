@@ -0,0 +1,58 @@
+/**
+ * @file eeprom.h
+ * @brief RAM backed stand-in for the EEPROM emulator on the host
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * Same interface as src/utils/eeprom.h, the pages are kept in RAM. Erased
+ * bytes read as 0xFF, like erased flash. Use `host_eeprom_erase()` to start
+ * a test with an unconfigured module.
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#ifndef _HOST_UTILS_EEPROM_H_
+#define _HOST_UTILS_EEPROM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "utils/status_codes.h"
+
+// Same layout as on the chip: 64 byte flash pages with a 4 byte header
+#define EEPROM_PAGE_SIZE 60
+
+#ifndef HOST_EEPROM_PAGES
+#define HOST_EEPROM_PAGES 16
+#endif
+
+struct eeprom_emulator_parameters {
+  uint8_t  page_size;
+  uint16_t eeprom_number_of_pages;
+};
+
+extern enum status_code eeprom_emulator_init(void);
+extern void eeprom_emulator_erase_memory(void);
+extern enum status_code eeprom_emulator_get_parameters(
+    struct eeprom_emulator_parameters *const parameters);
+extern enum status_code eeprom_emulator_commit_page_buffer(void);
+extern enum status_code eeprom_emulator_write_page(
+    const uint8_t logical_page,
+    const uint8_t *const data);
+extern enum status_code eeprom_emulator_read_page(
+    const uint8_t logical_page,
+    uint8_t *const data);
+extern enum status_code eeprom_emulator_write_buffer(
+    const uint16_t offset,
+    const uint8_t *const data,
+    const uint16_t length);
+extern enum status_code eeprom_emulator_read_buffer(
+    const uint16_t offset,
+    uint8_t *const data,
+    const uint16_t length);
+
+// Number of pages written, to check a test did (not) write
+extern uint32_t host_eeprom_writes;
+
+#endif // _HOST_UTILS_EEPROM_H_
@@ -123,14 +123,19 @@ void fast_clock_set_rate(uint8_t rate)
 }
 
 //----------------------------------------------------------------------------
-// This function processes the clock information sent on the loconet
-void loconet_rx_fast_clock(uint8_t *data, uint8_t length)
+// This function processes the clock information sent on the loconet. It
+// listens to write slot data messages of slot 0x7B.
+static void fast_clock_receive(uint8_t *message, uint8_t length)
 {
-  if (length < 8)
+  // Opcode, length, slot, 8 bytes of clock data and checksum
+  if (length < 12)
   {
     return;
   }
 
+  // Skip opcode, length and slot
+  uint8_t *data = &message[3];
+
   if (data[7] != 1) {
     // The message is not a correct clock tick!
     return;
@@ -194,6 +199,12 @@ void fast_clock_irq(void)
   }
 }
 
+// ----------------------------------------------------------------------------
+void fast_clock_init_rx(void)
+{
+  loconet_rx_listen(0xEF, fast_clock_receive, 2, 0x7F, 0x7B);
+}
+
 // ----------------------------------------------------------------------------
 void fast_clock_process(void)
 {
@@ -56,6 +56,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include "loconet/loconet_rx.h"
 #include "loconet/loconet_tx_messages.h"
 #include "utils/logger.h"
 
@@ -109,6 +110,7 @@ extern void fast_clock_process(void);
 // ------------------------------------------------------------------
 extern void fast_clock_init(void);
 extern void fast_clock_init_timer(Tc*, uint32_t, uint32_t, uint32_t);
+extern void fast_clock_init_rx(void);
 
 #define FAST_CLOCK_BUILD(timer)                                               \
   void fast_clock_init(void)                                                  \
@@ -119,6 +121,7 @@ extern void fast_clock_init_timer(Tc*, uint32_t, uint32_t, uint32_t);
       TC##timer##_GCLK_ID,                                                    \
       TC##timer##_IRQn                                                        \
     );                                                                        \
+    fast_clock_init_rx();                                                     \
   }                                                                           \
   /* Handle timer interrupt */                                                \
   void irq_handler_tc##timer(void);                                           \
@@ -129,10 +132,6 @@ extern void fast_clock_init_timer(Tc*, uint32_t, uint32_t, uint32_t);
     fast_clock_irq();                                                        \
   }                                                                           \
 
-// ------------------------------------------------------------------
-// Reacts on the fast clock messages to update the internal clock.
-extern void loconet_rx_fast_clock(uint8_t *data, uint8_t length);
-
 #else // COMPONENTS_FAST_CLOCK
 
 #define fast_clock_set_master(...) do {} while(0)
@@ -145,8 +144,8 @@ extern void loconet_rx_fast_clock(uint8_t *data, uint8_t length);
 #define fast_clock_process(...) do {} while(0)
 #define fast_clock_init(...) do {} while(0)
 #define fast_clock_init_timer(...) do {} while(0)
+#define fast_clock_init_rx(...) do {} while(0)
 #define FAST_CLOCK_BUILD(...)
-#define loconet_rx_fast_clock(...) do {} while(0)
 
 #endif // COMPONENTS_FAST_CLOCK
 
@@ -9,11 +9,17 @@
  * @author Jan Martijn van der Werf <janmartijn@slashdev.nl>
  */
 #include "loconet.h"
+#include "utils/timer.h"
+#include "utils/trace.h"
 
 //-----------------------------------------------------------------------------
 // Global variables
 LOCONET_CONFIG_Type loconet_config = { 0 };
 LOCONET_STATUS_Type loconet_status = { 0 };
+volatile LOCONET_STATS_Type loconet_stats = { 0, 0, 0, 0 };
+
+// Start (ms) of the current busy or idle period
+static uint32_t loconet_stats_since = 0;
 
 //-----------------------------------------------------------------------------
 typedef union {
@@ -36,19 +42,31 @@ typedef union {
 #define LOCONET_TIMER_STATUS_PRIORITY_DELAY_Pos 3
 #define LOCONET_TIMER_STATUS_PRIORITY_DELAY (0x01ul << LOCONET_TIMER_STATUS_PRIORITY_DELAY_Pos)
 
-#define LOCONET_DELAY_CARRIER_DETECT 1200 /* 20x bit time (60ux) */
-#define LOCONET_DELAY_MASTER_DELAY    360 /*  6x bit time (60us) */
-#define LOCONET_DELAY_LINE_BREAK      900 /* 15x bit time (60us) */
-#define LOCONET_DELAY_PRIORITY_DELAY   60 /*  1x bit time (60ux) */
-
 static LOCONET_TIMER_STATUS_Type loconet_timer_status = { 0 };
 
+//-----------------------------------------------------------------------------
+// Add the time since the last change between busy and idle to total
+static inline void loconet_stats_period(volatile uint32_t *total) {
+  uint32_t now = timer_ms();
+  *total += now - loconet_stats_since;
+  loconet_stats_since = now;
+}
+
+//-----------------------------------------------------------------------------
+static inline void loconet_line_busy(void) {
+  if (!loconet_status.bit.BUSY) {
+    loconet_stats_period(&loconet_stats.idle);
+    trace_event(TRACE_BUSY, 0, 0, 0);
+  }
+  loconet_status.reg |= LOCONET_STATUS_BUSY;
+}
+
 //-----------------------------------------------------------------------------
 void loconet_irq_flank_rise(void) {
   loconet_flank_timer_delay(LOCONET_DELAY_CARRIER_DETECT);
   loconet_timer_status.reg = LOCONET_TIMER_STATUS_CARRIER_DETECT;
   // If flank changes, loconet is busy
-  loconet_status.reg |= LOCONET_STATUS_BUSY;
+  loconet_line_busy();
 }
 
 //-----------------------------------------------------------------------------
@@ -56,7 +74,36 @@ void loconet_irq_flank_fall(void) {
   loconet_flank_timer_delay(LOCONET_DELAY_LINE_BREAK);
   loconet_timer_status.reg = LOCONET_TIMER_STATUS_LINE_BREAK;
   // If flank changes, loconet is busy
-  loconet_status.reg |= LOCONET_STATUS_BUSY;
+  loconet_line_busy();
+}
+
+//-----------------------------------------------------------------------------
+#ifdef LOCONET_FLANK_EVSYS
+void loconet_irq_flank_start(void) {
+  // Following flanks restart the timer without an interrupt
+  loconet_flank_timer_restart();
+  loconet_irq_flank_rise();
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// Carrier detect, master and priority delay have passed
+static inline void loconet_line_idle(void) {
+  trace_event(TRACE_IDLE, 0, 0, 0);
+  loconet_stats_period(&loconet_stats.busy);
+  loconet_status.bit.BUSY = 0;
+#ifdef LOCONET_FLANK_EVSYS
+  // Interrupt on the next flank to mark loconet as busy again
+  loconet_hw_wait_for_flank();
+#endif
+}
+
+//-----------------------------------------------------------------------------
+void loconet_irq_line_break(void) {
+  trace_event(TRACE_LINE_BREAK, 0, 0, 0);
+  // Remove collision detected flag
+  loconet_status.bit.COLLISION_DETECTED = 0;
+  loconet_hw_enable_rx_tx();
 }
 
 //-----------------------------------------------------------------------------
@@ -65,32 +112,35 @@ void loconet_irq_timer(void) {
   if (loconet_timer_status.bit.CARRIER_DETECT) {
     if (loconet_config.bit.MASTER) {
       // Master, remove busy flag directly
-      loconet_status.bit.BUSY = 0;
+      loconet_line_idle();
     } else {
       // Start master delay
+      trace_event(TRACE_MASTER_DELAY, 0, 0, 0);
       loconet_flank_timer_delay(LOCONET_DELAY_MASTER_DELAY);
       loconet_timer_status.reg = LOCONET_TIMER_STATUS_MASTER_DELAY;
     }
   } else if (loconet_timer_status.bit.MASTER_DELAY) {
-    if (loconet_config.bit.PRIORITY) {
+    uint8_t priority = loconet_tx_priority_delay(loconet_config.bit.PRIORITY);
+    if (priority) {
       // Start priority delay
-      loconet_flank_timer_delay(loconet_config.bit.PRIORITY * LOCONET_DELAY_PRIORITY_DELAY);
+      trace_event(TRACE_PRIORITY_DELAY, 0, priority, 0);
+      loconet_flank_timer_delay(priority * LOCONET_DELAY_PRIORITY_DELAY);
       loconet_timer_status.reg = LOCONET_TIMER_STATUS_PRIORITY_DELAY;
     } else {
-      loconet_status.bit.BUSY = 0;
+      loconet_line_idle();
     }
   } else if (loconet_timer_status.bit.PRIORITY_DELAY) {
-    loconet_status.bit.BUSY = 0;
+    loconet_line_idle();
   } else if (loconet_timer_status.bit.LINE_BREAK) {
-    // Remove collision detected flag
-    loconet_status.bit.COLLISION_DETECTED = 0;
-    loconet_hw_enable_rx_tx();
+    loconet_irq_line_break();
   }
 }
 
 //-----------------------------------------------------------------------------
 void loconet_irq_collision(void)
 {
+  loconet_stats.collisions++;
+  trace_event(TRACE_COLLISION, 0, loconet_status.bit.TRANSMIT, 0);
   // Set collision detected flag
   loconet_status.bit.COLLISION_DETECTED = 1;
   // Stop receiving and sending
@@ -108,6 +158,22 @@ void loconet_irq_collision(void)
   }
 }
 
+//-----------------------------------------------------------------------------
+void loconet_stats_time(uint32_t *busy, uint32_t *idle)
+{
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  uint32_t current = timer_ms() - loconet_stats_since;
+  *busy = loconet_stats.busy;
+  *idle = loconet_stats.idle;
+  if (loconet_status.bit.BUSY) {
+    *busy += current;
+  } else {
+    *idle += current;
+  }
+  __set_PRIMASK(primask);
+}
+
 //-----------------------------------------------------------------------------
 // Calculate the checksum of a message
 uint8_t loconet_calc_checksum(uint8_t *data, uint8_t length)
@@ -59,12 +59,39 @@ typedef union {
 
 extern LOCONET_STATUS_Type loconet_status;
 
+//-----------------------------------------------------------------------------
+// Bus statistics, updated from interrupts
+typedef struct {
+  uint32_t busy;       // Time (ms) the line was busy
+  uint32_t idle;       // Time (ms) the line was idle
+  uint16_t collisions; // Collisions, including framing errors
+  uint16_t framing;    // Framing errors (line breaks)
+} LOCONET_STATS_Type;
+
+extern volatile LOCONET_STATS_Type loconet_stats;
+
+// Time (ms) the line was busy and idle, including the period in progress
+extern void loconet_stats_time(uint32_t *busy, uint32_t *idle);
+
+//-----------------------------------------------------------------------------
+// Delays of the flank timer (us)
+#define LOCONET_DELAY_CARRIER_DETECT 1200 /* 20x bit time (60ux) */
+#define LOCONET_DELAY_MASTER_DELAY    360 /*  6x bit time (60us) */
+#define LOCONET_DELAY_LINE_BREAK      900 /* 15x bit time (60us) */
+#define LOCONET_DELAY_PRIORITY_DELAY   60 /*  1x bit time (60ux) */
+
 //-----------------------------------------------------------------------------
 // IRQs for flank rise / fall
 extern void loconet_irq_flank_rise(void);
 extern void loconet_irq_flank_fall(void);
 // IRQ for timeout of timer
 extern void loconet_irq_timer(void);
+// IRQ for a line break (line low for 15 bit times)
+extern void loconet_irq_line_break(void);
+#ifdef LOCONET_FLANK_EVSYS
+// IRQ for the first flank after the line was idle
+extern void loconet_irq_flank_start(void);
+#endif
 // IRQ for collision detected
 extern void loconet_irq_collision(void);
 // IRQ for flank detection
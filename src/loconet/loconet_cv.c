@@ -10,6 +10,19 @@
  */
 
 #include "loconet_cv.h"
+#include "loconet_fault.h"
+#include "loconet_filter.h"
+#include "utils/memory.h"
+
+#if LOCONET_CV_STATS < LOCONET_CV_NUMBERS
+#error "LOCONET_CV_STATS overlaps with the LNCVs of the module"
+#endif
+
+#if LOCONET_CV_FAULT < LOCONET_CV_NUMBERS \
+  || (LOCONET_CV_FAULT < LOCONET_CV_STATS + LOCONET_CV_STATS_NUMBERS \
+    && LOCONET_CV_STATS < LOCONET_CV_FAULT + LOCONET_CV_FAULT_NUMBERS)
+#error "LOCONET_CV_FAULT overlaps with other LNCVs"
+#endif
 
 bool loconet_cv_programming;
 
@@ -61,10 +74,93 @@ uint8_t loconet_cv_write_allowed_core(uint16_t lncv_number, uint16_t lncv_value)
   }
 }
 
+//-----------------------------------------------------------------------------
+// Is the LNCV one of the statistics?
+static inline bool loconet_cv_is_stat(uint16_t lncv_number)
+{
+  return lncv_number >= LOCONET_CV_STATS
+    && lncv_number < LOCONET_CV_STATS + LOCONET_CV_STATS_NUMBERS;
+}
+
+//-----------------------------------------------------------------------------
+// Is the LNCV part of the saved hard fault?
+static inline bool loconet_cv_is_fault(uint16_t lncv_number)
+{
+  return lncv_number >= LOCONET_CV_FAULT
+    && lncv_number < LOCONET_CV_FAULT + LOCONET_CV_FAULT_NUMBERS;
+}
+
+//-----------------------------------------------------------------------------
+// Copy of the 32 bit counters, taken when the low word of one of them is
+// read. The high word is read from the copy, so both words belong to the
+// same value.
+typedef struct {
+  uint32_t busy;
+  uint32_t idle;
+  uint32_t wait_total;
+} LOCONET_CV_STATS_SNAPSHOT_Type;
+
+static LOCONET_CV_STATS_SNAPSHOT_Type loconet_cv_stats_snapshot;
+
+static void loconet_cv_stats_take_snapshot(void)
+{
+  LOCONET_CV_STATS_SNAPSHOT_Type *snapshot = &loconet_cv_stats_snapshot;
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  loconet_stats_time(&snapshot->busy, &snapshot->idle);
+  snapshot->wait_total = loconet_tx_stats.wait_total;
+  __set_PRIMASK(primask);
+}
+
+//-----------------------------------------------------------------------------
+// Statistics are read from the counters, 32 bit counters take two LNCVs
+// (low word first).
+static uint16_t loconet_cv_stat(uint16_t index)
+{
+  LOCONET_CV_STATS_SNAPSHOT_Type *snapshot = &loconet_cv_stats_snapshot;
+
+  switch (index) {
+    case 0:
+    case 2:
+    case 12:
+      loconet_cv_stats_take_snapshot();
+      break;
+  }
+
+  switch (index) {
+    case 0:  return snapshot->busy & 0xFFFF;
+    case 1:  return snapshot->busy >> 16;
+    case 2:  return snapshot->idle & 0xFFFF;
+    case 3:  return snapshot->idle >> 16;
+    case 4:  return loconet_rx_stats.received;
+    case 5:  return loconet_rx_stats.checksum;
+    case 6:  return loconet_stats.framing;
+    case 7:  return loconet_stats.collisions;
+    case 8:  return loconet_tx_stats.transmitted;
+    case 9:  return loconet_tx_stats.retries;
+    case 10: return loconet_tx_stats.abandoned;
+    case 11: return loconet_tx_stats.rejected;
+    case 12: return snapshot->wait_total & 0xFFFF;
+    case 13: return snapshot->wait_total >> 16;
+    case 14: return loconet_tx_stats.wait_max;
+    case 15: return loconet_rx_stats.overrun;
+    case 16: return loconet_rx_stats.dropped;
+    case 17: return loconet_rx_stats.ignored;
+    case 18: return memory_stack_used();
+    case 19: return memory_stack_size();
+    case 20: return memory_heap_used();
+    case 21: return memory_heap_size();
+    default: return 0xFFFF;
+  }
+}
+
 //-----------------------------------------------------------------------------
 static void loconet_cv_response(LOCONET_CV_MSG_Type *msg)
 {
-  uint8_t resp_data[13];
+  uint8_t *resp_data;
+  if (loconet_tx_reserve(0xE5, 1, 13, &resp_data) != STATUS_OK) {
+    return;
+  }
   resp_data[0] = 15; // Length
 
   LOCONET_CV_MSG_Type *resp = (LOCONET_CV_MSG_Type*)&resp_data[1];
@@ -92,7 +188,7 @@ static void loconet_cv_response(LOCONET_CV_MSG_Type *msg)
   }
 
   // Send message
-  loconet_tx_queue_n(0xE5, 1, resp_data, 13);
+  loconet_tx_commit();
 }
 
 //-----------------------------------------------------------------------------
@@ -120,7 +216,8 @@ static void loconet_cv_prog_off(LOCONET_CV_MSG_Type *msg)
 //-----------------------------------------------------------------------------
 static void loconet_cv_prog_read(LOCONET_CV_MSG_Type *msg, uint8_t opcode)
 {
-  if (msg->lncv_number >= LOCONET_CV_NUMBERS) {
+  if (msg->lncv_number >= LOCONET_CV_NUMBERS && !loconet_cv_is_stat(msg->lncv_number)
+    && !loconet_cv_is_fault(msg->lncv_number)) {
     loconet_tx_long_ack(opcode, LOCONET_CV_ACK_ERROR_OUTOFRANGE);
     return;
   }
@@ -159,6 +256,12 @@ void loconet_cv_process(LOCONET_CV_MSG_Type *msg, uint8_t opcode)
 //-----------------------------------------------------------------------------
 uint16_t loconet_cv_get(uint16_t lncv_number)
 {
+  if (loconet_cv_is_stat(lncv_number)) {
+    return loconet_cv_stat(lncv_number - LOCONET_CV_STATS);
+  }
+  if (loconet_cv_is_fault(lncv_number)) {
+    return loconet_fault_cv(lncv_number - LOCONET_CV_FAULT);
+  }
   if (lncv_number >= LOCONET_CV_NUMBERS) {
     return 0xFFFF;
   }
@@ -181,8 +284,8 @@ uint16_t loconet_cv_get(uint16_t lncv_number)
 //-----------------------------------------------------------------------------
 uint8_t loconet_cv_set(uint16_t lncv_number, uint16_t lncv_value)
 {
-  // Do not allow to write to number 1
-  if (lncv_number == 1) {
+  // Do not allow to write to number 1, the statistics and the fault
+  if (lncv_number == 1 || loconet_cv_is_stat(lncv_number) || loconet_cv_is_fault(lncv_number)) {
     return LOCONET_CV_ACK_ERROR_READONLY;
   // Do not allow to write out of bounds
   } else if (lncv_number >= LOCONET_CV_NUMBERS) {
@@ -211,6 +314,7 @@ uint8_t loconet_cv_set(uint16_t lncv_number, uint16_t lncv_value)
     }
     eeprom_emulator_write_page(page, (uint8_t *)page_data);
     eeprom_emulator_commit_page_buffer();
+    loconet_filter_cv_written(lncv_number);
     loconet_cv_written_event(lncv_number, lncv_value);
   }
 
@@ -230,6 +334,9 @@ enum status_code loconet_cv_init(void)
   loconet_config.bit.ADDRESS = loconet_cv_get(0);
   loconet_config.bit.PRIORITY = loconet_cv_get(2);
 
+  // Get owned switch and sensor addresses
+  loconet_filter_init();
+
   // Disable programming on init
   loconet_cv_programming = false;
 
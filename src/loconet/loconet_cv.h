@@ -35,6 +35,18 @@
 #define LOCONET_CV_INITIAL_ADDRESS  0x03  // Initial address we listen to
 #define LOCONET_CV_INITIAL_PRIORITY 0x05  // Initial priority for sending
 
+// Statistics are read-only LNCVs, starting at LOCONET_CV_STATS
+#ifndef LOCONET_CV_STATS
+#define LOCONET_CV_STATS            0x400 // 1024
+#endif
+#define LOCONET_CV_STATS_NUMBERS    22
+
+// A saved hard fault is read from read-only LNCVs, see loconet_fault.h
+#ifndef LOCONET_CV_FAULT
+#define LOCONET_CV_FAULT            0x420 // 1056
+#endif
+#define LOCONET_CV_FAULT_NUMBERS    15
+
 #define LOCONET_CV_SRC_MASTER       0x00
 #define LOCONET_CV_SRC_KPU          0x01 // KPU is, e.g., an IntelliBox
 #define LOCONET_CV_SRC_UNDEFINED    0x02 // Unknown source
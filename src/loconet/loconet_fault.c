@@ -0,0 +1,170 @@
+/**
+ * @file loconet_fault.c
+ * @brief Keep the state of a hard fault for the next boot
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#include "loconet_fault.h"
+#include "loconet.h"
+#include "loconet_rx.h"
+#include "loconet_tx.h"
+#include "utils/logger.h"
+#include "utils/timer.h"
+
+__attribute__ ((section (".noinit"))) LOCONET_FAULT_Type loconet_fault;
+uint8_t loconet_fault_reset_cause;
+
+//-----------------------------------------------------------------------------
+// Prototypes
+void irq_handler_hard_fault(void);
+void loconet_fault_capture(uint32_t *frame);
+
+//-----------------------------------------------------------------------------
+// Pass the stack the exception frame was pushed on to loconet_fault_capture
+__attribute__ ((naked)) void irq_handler_hard_fault(void)
+{
+  __asm volatile (
+    "movs r0, #4              \n"
+    "mov r1, lr               \n"
+    "tst r0, r1               \n"
+    "beq 1f                   \n"
+    "mrs r0, psp              \n"
+    "b 2f                     \n"
+    "1:                       \n"
+    "mrs r0, msp              \n"
+    "2:                       \n"
+    "ldr r1, =loconet_fault_capture \n"
+    "bx r1                    \n"
+  );
+}
+
+//-----------------------------------------------------------------------------
+void loconet_fault_capture(uint32_t *frame)
+{
+  loconet_fault.count = loconet_fault.magic == LOCONET_FAULT_MAGIC ? loconet_fault.count + 1 : 1;
+  loconet_fault.magic = LOCONET_FAULT_MAGIC;
+  loconet_fault.reported = 0;
+
+  loconet_fault.r0 = frame[0];
+  loconet_fault.r1 = frame[1];
+  loconet_fault.r2 = frame[2];
+  loconet_fault.r3 = frame[3];
+  loconet_fault.r12 = frame[4];
+  loconet_fault.lr = frame[5];
+  loconet_fault.pc = frame[6];
+  loconet_fault.xpsr = frame[7];
+  // The frame is 8 words, with a word of padding when bit 9 of xPSR is set
+  loconet_fault.sp = (uint32_t)&frame[8] + ((frame[7] & (1 << 9)) ? 4 : 0);
+
+  loconet_fault.time = timer_ms();
+  loconet_fault.tx_queue = loconet_tx_queue_size();
+  loconet_fault.rx_level = loconet_rx_buffer_level();
+  loconet_fault.status = loconet_status.reg;
+#ifdef UTILS_TRACE
+  loconet_fault.traces = trace_copy(loconet_fault.trace, LOCONET_FAULT_TRACE);
+#endif
+
+  NVIC_SystemReset();
+}
+
+//-----------------------------------------------------------------------------
+uint8_t loconet_fault_saved(void)
+{
+  return loconet_fault.magic == LOCONET_FAULT_MAGIC;
+}
+
+// Do we want logging?
+#ifdef UTILS_LOGGER
+
+//-----------------------------------------------------------------------------
+static void loconet_fault_log_hex(const char *name, uint32_t value)
+{
+  logger_cstring(name);
+  logger_number_as_hex(value);
+}
+
+//-----------------------------------------------------------------------------
+static void loconet_fault_report(void)
+{
+  uint8_t policy = logger_set_policy(LOGGER_WAIT);
+  logger_cstring("HARD FAULT ");
+  logger_number(loconet_fault.count);
+  loconet_fault_log_hex(" pc ", loconet_fault.pc);
+  loconet_fault_log_hex(" lr ", loconet_fault.lr);
+  loconet_fault_log_hex(" xpsr ", loconet_fault.xpsr);
+  loconet_fault_log_hex(" sp ", loconet_fault.sp);
+  logger_newline();
+  loconet_fault_log_hex("r0 ", loconet_fault.r0);
+  loconet_fault_log_hex(" r1 ", loconet_fault.r1);
+  loconet_fault_log_hex(" r2 ", loconet_fault.r2);
+  loconet_fault_log_hex(" r3 ", loconet_fault.r3);
+  loconet_fault_log_hex(" r12 ", loconet_fault.r12);
+  logger_newline();
+  logger_cstring("time ");
+  logger_number(loconet_fault.time);
+  logger_cstring(" tx queue ");
+  logger_number(loconet_fault.tx_queue);
+  logger_cstring(" rx level ");
+  logger_number(loconet_fault.rx_level);
+  loconet_fault_log_hex(" status ", loconet_fault.status);
+  logger_newline();
+#ifdef UTILS_TRACE
+  trace_dump_records(loconet_fault.trace, loconet_fault.traces);
+  logger_newline();
+#endif
+  logger_set_policy(policy);
+}
+
+#else // UTILS_LOGGER
+
+#define loconet_fault_report(...) do {} while (0)
+
+#endif // UTILS_LOGGER
+
+//-----------------------------------------------------------------------------
+void loconet_fault_init(void)
+{
+  loconet_fault_reset_cause = PM->RCAUSE.reg;
+
+  // Only report a fault once, it is kept for the LNCVs
+  if (!loconet_fault_saved() || loconet_fault.reported) {
+    return;
+  }
+  loconet_fault.reported = 1;
+  loconet_fault_report();
+}
+
+//-----------------------------------------------------------------------------
+// 32 bit values take two LNCVs (low word first)
+uint16_t loconet_fault_cv(uint16_t index)
+{
+  // The reset cause is known without a fault
+  if (index == 1) {
+    return loconet_fault_reset_cause;
+  }
+  if (!loconet_fault_saved()) {
+    return index == 0 ? 0 : 0xFFFF;
+  }
+
+  switch (index) {
+    case 0:  return loconet_fault.count;
+    case 2:  return loconet_fault.pc & 0xFFFF;
+    case 3:  return loconet_fault.pc >> 16;
+    case 4:  return loconet_fault.lr & 0xFFFF;
+    case 5:  return loconet_fault.lr >> 16;
+    case 6:  return loconet_fault.xpsr & 0xFFFF;
+    case 7:  return loconet_fault.xpsr >> 16;
+    case 8:  return loconet_fault.sp & 0xFFFF;
+    case 9:  return loconet_fault.sp >> 16;
+    case 10: return loconet_fault.time & 0xFFFF;
+    case 11: return loconet_fault.time >> 16;
+    case 12: return loconet_fault.tx_queue;
+    case 13: return loconet_fault.rx_level;
+    case 14: return loconet_fault.status;
+    default: return 0xFFFF;
+  }
+}
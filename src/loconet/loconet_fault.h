@@ -0,0 +1,72 @@
+/**
+ * @file loconet_fault.h
+ * @brief Keep the state of a hard fault for the next boot
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * The hard fault handler saves the exception frame, the stack pointer, the
+ * state of the loconet queues and, with UTILS_TRACE, the last
+ * LOCONET_FAULT_TRACE (default 8) trace events in RAM which is not cleared
+ * at reset (the .noinit section). Then it resets the module.
+ *
+ * `loconet_fault_init()`, called after the logger is initialized, writes a
+ * saved fault to the logger. The fault can also be read as read-only LNCVs
+ * starting at LOCONET_CV_FAULT, so a module in the field can be diagnosed
+ * without a debugger or logger attached. The fault is kept until the next
+ * fault or a power cycle.
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#ifndef _LOCONET_LOCONET_FAULT_H_
+#define _LOCONET_LOCONET_FAULT_H_
+
+#include <stdint.h>
+#include "utils/trace.h"
+
+//-----------------------------------------------------------------------------
+#ifndef LOCONET_FAULT_TRACE
+#define LOCONET_FAULT_TRACE 8
+#endif
+
+// Marks a saved fault, RAM has a random value after a power cycle
+#define LOCONET_FAULT_MAGIC 0x4C4E4846 // LNHF
+
+typedef struct {
+  uint32_t magic;
+  uint32_t count;    // Faults since the last power cycle
+  // Exception frame
+  uint32_t r0;
+  uint32_t r1;
+  uint32_t r2;
+  uint32_t r3;
+  uint32_t r12;
+  uint32_t lr;
+  uint32_t pc;
+  uint32_t xpsr;
+  uint32_t sp;       // Stack pointer before the exception
+  uint32_t time;     // Milliseconds since boot
+  uint16_t tx_queue; // Messages in the transmit queue
+  uint16_t rx_level; // Bytes in the receive buffer
+  uint8_t status;    // loconet_status
+  uint8_t reported;  // Written to the logger
+#ifdef UTILS_TRACE
+  uint8_t traces;    // Number of trace events
+  TRACE_RECORD_Type trace[LOCONET_FAULT_TRACE];
+#endif
+} LOCONET_FAULT_Type;
+
+extern LOCONET_FAULT_Type loconet_fault;
+// PM->RCAUSE of the last reset
+extern uint8_t loconet_fault_reset_cause;
+
+//-----------------------------------------------------------------------------
+// Check for a saved fault and write it to the logger
+extern void loconet_fault_init(void);
+// Is a fault saved?
+extern uint8_t loconet_fault_saved(void);
+// Value of the LNCV at index in the fault range
+extern uint16_t loconet_fault_cv(uint16_t index);
+
+#endif // _LOCONET_LOCONET_FAULT_H_
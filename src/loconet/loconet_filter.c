@@ -0,0 +1,172 @@
+/**
+ * @file loconet_filter.c
+ * @brief Filter switch and sensor messages on owned addresses
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#include "loconet_filter.h"
+#include "loconet_cv.h"
+
+#if LOCONET_FILTER_SENSOR_CV + LOCONET_FILTER_SENSORS > LOCONET_CV_NUMBERS \
+  || LOCONET_FILTER_SWITCH_CV + LOCONET_FILTER_SWITCHES > LOCONET_CV_NUMBERS
+#error "LOCONET_CV_NUMBERS is too small for the filter LNCVs"
+#endif
+
+//-----------------------------------------------------------------------------
+// Prototypes
+void loconet_filter_dummy(uint8_t, uint16_t, uint8_t);
+
+//-----------------------------------------------------------------------------
+#define LOCONET_FILTER_DUMMY(name) \
+  __attribute__ ((weak, alias ("loconet_filter_dummy"))) \
+  void loconet_rx_owned_##name(uint8_t, uint16_t, uint8_t)
+
+LOCONET_FILTER_DUMMY(sw_req);
+LOCONET_FILTER_DUMMY(sw_rep);
+LOCONET_FILTER_DUMMY(input_rep);
+
+//-----------------------------------------------------------------------------
+typedef struct {
+  uint16_t address;
+  uint8_t index;  // Position of the LNCV in its range
+} LOCONET_FILTER_ENTRY_Type;
+
+// Owned addresses sorted on address, entries with the same address are
+// sorted on index.
+typedef struct {
+  LOCONET_FILTER_ENTRY_Type *entries;
+  uint16_t cv;    // First LNCV
+  uint8_t size;   // Number of LNCVs
+  uint8_t used;   // Number of entries with an address
+  uint16_t min;   // Lowest valid address
+  uint16_t max;   // Highest valid address
+} LOCONET_FILTER_TABLE_Type;
+
+static LOCONET_FILTER_ENTRY_Type loconet_filter_switch_entries[LOCONET_FILTER_SWITCHES ? LOCONET_FILTER_SWITCHES : 1];
+static LOCONET_FILTER_ENTRY_Type loconet_filter_sensor_entries[LOCONET_FILTER_SENSORS ? LOCONET_FILTER_SENSORS : 1];
+
+static LOCONET_FILTER_TABLE_Type loconet_filter_switches = {
+  loconet_filter_switch_entries, LOCONET_FILTER_SWITCH_CV, LOCONET_FILTER_SWITCHES, 0,
+  1, LOCONET_FILTER_SWITCH_MAX
+};
+
+static LOCONET_FILTER_TABLE_Type loconet_filter_sensors = {
+  loconet_filter_sensor_entries, LOCONET_FILTER_SENSOR_CV, LOCONET_FILTER_SENSORS, 0,
+  1, LOCONET_FILTER_SENSOR_MAX
+};
+
+//-----------------------------------------------------------------------------
+// Read the addresses of a table from the LNCVs and sort them
+static void loconet_filter_build(LOCONET_FILTER_TABLE_Type *table)
+{
+  table->used = 0;
+
+  for (uint8_t index = 0; index < table->size; index++) {
+    uint16_t address = loconet_cv_get(table->cv + index);
+    if (address < table->min || address > table->max) {
+      continue;
+    }
+
+    // Insert sorted, the table is small and only built on changes
+    uint8_t position = table->used++;
+    while (position > 0 && table->entries[position - 1].address > address) {
+      table->entries[position] = table->entries[position - 1];
+      position--;
+    }
+    table->entries[position].address = address;
+    table->entries[position].index = index;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Call the handler for every entry with the address
+static void loconet_filter_find(LOCONET_FILTER_TABLE_Type *table, uint16_t address, uint8_t state,
+  void (*handler)(uint8_t, uint16_t, uint8_t))
+{
+  // Find the first entry with an address not below address
+  uint8_t low = 0;
+  uint8_t high = table->used;
+  while (low < high) {
+    uint8_t middle = (low + high) >> 1;
+    if (table->entries[middle].address < address) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  for (; low < table->used && table->entries[low].address == address; low++) {
+    handler(table->entries[low].index, address, state);
+  }
+}
+
+//-----------------------------------------------------------------------------
+void loconet_filter_init(void)
+{
+  loconet_filter_build(&loconet_filter_switches);
+  loconet_filter_build(&loconet_filter_sensors);
+}
+
+//-----------------------------------------------------------------------------
+void loconet_filter_cv_written(uint16_t lncv_number)
+{
+  if (lncv_number >= LOCONET_FILTER_SWITCH_CV
+    && lncv_number < LOCONET_FILTER_SWITCH_CV + LOCONET_FILTER_SWITCHES) {
+    loconet_filter_build(&loconet_filter_switches);
+  }
+  if (lncv_number >= LOCONET_FILTER_SENSOR_CV
+    && lncv_number < LOCONET_FILTER_SENSOR_CV + LOCONET_FILTER_SENSORS) {
+    loconet_filter_build(&loconet_filter_sensors);
+  }
+}
+
+//-----------------------------------------------------------------------------
+uint8_t loconet_filter_is_interesting(uint8_t opcode)
+{
+  switch (opcode) {
+    case 0xB0:
+      return LOCONET_FILTER_SWITCHES && loconet_rx_owned_sw_req != loconet_filter_dummy;
+    case 0xB1:
+      return LOCONET_FILTER_SWITCHES && loconet_rx_owned_sw_rep != loconet_filter_dummy;
+    case 0xB2:
+      return LOCONET_FILTER_SENSORS && loconet_rx_owned_input_rep != loconet_filter_dummy;
+    default:
+      return 0;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Switch request (OPC_SW_REQ)
+void loconet_filter_sw_req(uint8_t sw1, uint8_t sw2)
+{
+  uint16_t address = (((sw2 & 0x0F) << 7) | sw1) + 1;
+  loconet_filter_find(&loconet_filter_switches, address, sw2 >> 4, loconet_rx_owned_sw_req);
+}
+
+//-----------------------------------------------------------------------------
+// Switch report (OPC_SW_REP)
+void loconet_filter_sw_rep(uint8_t sn1, uint8_t sn2)
+{
+  uint16_t address = (((sn2 & 0x0F) << 7) | sn1) + 1;
+  loconet_filter_find(&loconet_filter_switches, address, sn2 >> 4, loconet_rx_owned_sw_rep);
+}
+
+//-----------------------------------------------------------------------------
+// Sensor report (OPC_INPUT_REP), the I bit is the lowest bit of the address
+void loconet_filter_input_rep(uint8_t in1, uint8_t in2)
+{
+  uint16_t address = ((((in2 & 0x0F) << 7) | in1) << 1) + ((in2 >> 5) & 0x01) + 1;
+  loconet_filter_find(&loconet_filter_sensors, address, (in2 >> 4) & 0x01, loconet_rx_owned_input_rep);
+}
+
+//-----------------------------------------------------------------------------
+void loconet_filter_dummy(uint8_t index, uint16_t address, uint8_t state)
+{
+  (void)index;
+  (void)address;
+  (void)state;
+}
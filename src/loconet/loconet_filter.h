@@ -0,0 +1,89 @@
+/**
+ * @file loconet_filter.h
+ * @brief Filter switch and sensor messages on owned addresses
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * Switch requests (0xB0), switch reports (0xB1) and sensor reports (0xB2)
+ * are sent for every address on the bus, while a module only owns a few of
+ * them. The filter decodes the address of these messages and looks it up in
+ * a sorted table of owned addresses. Only for owned addresses one of the
+ * following handlers is called:
+ *
+ *     void loconet_rx_owned_sw_req(uint8_t index, uint16_t address, uint8_t state);
+ *     void loconet_rx_owned_sw_rep(uint8_t index, uint16_t address, uint8_t state);
+ *     void loconet_rx_owned_input_rep(uint8_t index, uint16_t address, uint8_t state);
+ *
+ * Where
+ * - index: position of the address in the LNCV range, starting at 0
+ * - address: decoded address, numbered from 1 like throttles and control
+ *            software show them (switches 1 - 2048, sensors 1 - 4096)
+ * - state: bits of the message above the address, for a switch request
+ *          bit 0 is ON and bit 1 is DIR. For sensors it is the L bit.
+ *
+ * The owned addresses are read from LNCVs. Define the number of switches
+ * and sensors, and optionally the first LNCV of each range:
+ *
+ *     LOCONET_FILTER_SWITCHES    number of switch addresses (default 0)
+ *     LOCONET_FILTER_SWITCH_CV   first LNCV (default 3)
+ *     LOCONET_FILTER_SENSORS     number of sensor addresses (default 0)
+ *     LOCONET_FILTER_SENSOR_CV   first LNCV (default after the switches)
+ *
+ * The LNCVs hold addresses in the same numbering, starting at 1 for both
+ * switches and sensors. An LNCV with an address out of range (e.g. 0 or
+ * 0xFFFF) is not used. The tables are rebuilt when one of these LNCVs is
+ * written.
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#ifndef _LOCONET_LOCONET_FILTER_H_
+#define _LOCONET_LOCONET_FILTER_H_
+
+#include <stdint.h>
+
+//-----------------------------------------------------------------------------
+#ifndef LOCONET_FILTER_SWITCHES
+#define LOCONET_FILTER_SWITCHES 0
+#endif
+
+#ifndef LOCONET_FILTER_SWITCH_CV
+#define LOCONET_FILTER_SWITCH_CV 3
+#endif
+
+#ifndef LOCONET_FILTER_SENSORS
+#define LOCONET_FILTER_SENSORS 0
+#endif
+
+#ifndef LOCONET_FILTER_SENSOR_CV
+#define LOCONET_FILTER_SENSOR_CV (LOCONET_FILTER_SWITCH_CV + LOCONET_FILTER_SWITCHES)
+#endif
+
+// Highest switch and sensor address, the lowest is 1
+#define LOCONET_FILTER_SWITCH_MAX 0x0800
+#define LOCONET_FILTER_SENSOR_MAX 0x1000
+
+//-----------------------------------------------------------------------------
+// Handlers for owned addresses
+extern void loconet_rx_owned_sw_req(uint8_t, uint16_t, uint8_t);
+extern void loconet_rx_owned_sw_rep(uint8_t, uint16_t, uint8_t);
+extern void loconet_rx_owned_input_rep(uint8_t, uint16_t, uint8_t);
+
+//-----------------------------------------------------------------------------
+// Read the owned addresses from the LNCVs
+extern void loconet_filter_init(void);
+// Rebuild the tables if lncv_number holds an owned address
+extern void loconet_filter_cv_written(uint16_t lncv_number);
+
+//-----------------------------------------------------------------------------
+// Do messages with this opcode have to be received for the filter?
+extern uint8_t loconet_filter_is_interesting(uint8_t opcode);
+
+//-----------------------------------------------------------------------------
+// Find the owned address of a received message and call its handler
+extern void loconet_filter_sw_req(uint8_t, uint8_t);
+extern void loconet_filter_sw_rep(uint8_t, uint8_t);
+extern void loconet_filter_input_rep(uint8_t, uint8_t);
+
+#endif // _LOCONET_LOCONET_FILTER_H_
@@ -16,6 +16,17 @@ Sercom *loconet_sercom;
 Tc *loconet_flank_timer;
 PortGroup *loconet_tx_port;
 uint32_t loconet_tx_pin;
+// External interrupt of the flank pin
+uint32_t loconet_flank_interrupt;
+
+//-----------------------------------------------------------------------------
+// Number of interrupts, to measure interrupt rates
+volatile LOCONET_IRQ_STATS_Type loconet_irq_stats = { 0, 0, 0 };
+
+#ifdef LOCONET_FLANK_EVSYS
+// Time since the last flank at which the running delay ends
+static uint16_t loconet_flank_timer_match = 0;
+#endif
 
 //-----------------------------------------------------------------------------
 // Initialize USART for loconet
@@ -92,8 +103,16 @@ void loconet_init_flank_detection(uint8_t fl_int)
     | GCLK_CLKCTRL_CLKEN
     | GCLK_CLKCTRL_GEN(0);
 
+  loconet_flank_interrupt = 0x01ul << fl_int;
+
+#ifdef LOCONET_FLANK_EVSYS
+  // Generate an event for the flank timer, the interrupt is only enabled
+  // while loconet is idle
+  EIC->EVCTRL.reg |= EIC_EVCTRL_EXTINTEO(loconet_flank_interrupt);
+#else
   // Enable interrupt for external pin
-  EIC->INTENSET.reg |= EIC_EVCTRL_EXTINTEO(0x01ul << fl_int);
+  EIC->INTENSET.reg |= EIC_EVCTRL_EXTINTEO(loconet_flank_interrupt);
+#endif
   EIC->CONFIG[fl_int / 8].reg = EIC_CONFIG_SENSE0_BOTH << 4 * (fl_int % 8);
   NVIC_EnableIRQ(EIC_IRQn);
 
@@ -115,6 +134,55 @@ void loconet_init_flank_timer(Tc *timer, uint32_t pm_tmr_mask, uint32_t gclock_t
     | GCLK_CLKCTRL_CLKEN
     | GCLK_CLKCTRL_GEN(0);
 
+#ifdef LOCONET_FLANK_EVSYS
+  /* CTRLA register:
+   *   PRESCSYNC: 0x02  RESYNC
+   *   RUNSTDBY:        Ignored
+   *   PRESCALER: 0x03  DIV8, each tick will be 1us
+   *   WAVEGEN:   0x00  NFRQ, count up to the top
+   *   MODE:      0x00  16 bits timer
+   */
+  loconet_flank_timer->COUNT16.CTRLA.reg =
+    TC_CTRLA_PRESCSYNC_RESYNC
+    | TC_CTRLA_PRESCALER_DIV8
+    | TC_CTRLA_WAVEGEN_NFRQ
+    | TC_CTRLA_MODE_COUNT16;
+  // Stop at the top, until a flank starts the timer again
+  loconet_flank_timer->COUNT16.CTRLBSET.reg = TC_CTRLBSET_ONESHOT;
+  // Every flank restarts the timer
+  loconet_flank_timer->COUNT16.EVCTRL.reg = TC_EVCTRL_TCEI | TC_EVCTRL_EVACT_RETRIGGER;
+
+  /* INTERRUPTS:
+   *   Interrupt on match 0: line break
+   *   Interrupt on match 1: carrier detect, master and priority delay
+   */
+  loconet_flank_timer->COUNT16.CC[0].reg = LOCONET_DELAY_LINE_BREAK;
+  loconet_flank_timer->COUNT16.INTENSET.reg = TC_INTENSET_MC(3);
+  NVIC_EnableIRQ(nvic_irqn);
+
+  // Start the carrier detect at least once
+  loconet_irq_flank_start();
+  loconet_flank_timer->COUNT16.CTRLA.reg |= TC_CTRLA_ENABLE;
+}
+
+//-----------------------------------------------------------------------------
+// Route flanks of the flank pin to the flank timer
+void loconet_init_flank_event(uint8_t fl_int, uint8_t evsys_user)
+{
+  // Enable clock for the event system, the asynchronous path needs no
+  // generic clock
+  PM->APBCMASK.reg |= PM_APBCMASK_EVSYS;
+
+  EVSYS->USER.reg =
+    EVSYS_USER_CHANNEL(LOCONET_FLANK_EVSYS_CHANNEL + 1)
+    | EVSYS_USER_USER(evsys_user);
+  EVSYS->CHANNEL.reg =
+    EVSYS_CHANNEL_CHANNEL(LOCONET_FLANK_EVSYS_CHANNEL)
+    | EVSYS_CHANNEL_EDGSEL_NO_EVT_OUTPUT
+    | EVSYS_CHANNEL_PATH_ASYNCHRONOUS
+    | EVSYS_CHANNEL_EVGEN(EVSYS_ID_GEN_EIC_EXTINT_0 + fl_int);
+}
+#else
   /* CTRLA register:
    *   PRESCSYNC: 0x02  RESYNC
    *   RUNSTDBY:        Ignored
@@ -137,6 +205,7 @@ void loconet_init_flank_timer(Tc *timer, uint32_t pm_tmr_mask, uint32_t gclock_t
   // Start the flank rise at least once
   loconet_irq_flank_rise();
 }
+#endif
 
 //-----------------------------------------------------------------------------
 // Save which pin is connected to TX
@@ -150,6 +219,8 @@ void loconet_save_tx_pin(PortGroup *group, uint32_t pin)
 // Handle sercom (usart) interrupt
 void loconet_irq_sercom(void)
 {
+  loconet_irq_stats.sercom++;
+
   // Rx complete
   if (loconet_sercom->USART.INTFLAG.bit.RXC) {
     if (loconet_status.bit.COLLISION_DETECTED) {
@@ -161,6 +232,7 @@ void loconet_irq_sercom(void)
       // Reset flag
       loconet_sercom->USART.STATUS.reg |= SERCOM_USART_STATUS_FERR;
       // Framing error -> Collision detected
+      loconet_stats.framing++;
       loconet_irq_collision();
     } else if (loconet_status.bit.TRANSMIT) {
       // Read own bytes to see if we have a collision
@@ -168,6 +240,11 @@ void loconet_irq_sercom(void)
         loconet_irq_collision();
       }
     } else {
+      // Did we lose bytes before this one?
+      if (loconet_sercom->USART.STATUS.bit.BUFOVF) {
+        loconet_sercom->USART.STATUS.reg |= SERCOM_USART_STATUS_BUFOVF;
+        loconet_rx_buffer_overrun();
+      }
       // Turn activity led on
       loconet_activity_led_on();
       // Get data from USART and place it in the ringbuffer
@@ -211,6 +288,28 @@ void loconet_irq_sercom(void)
 }
 
 //-----------------------------------------------------------------------------
+#ifdef LOCONET_FLANK_EVSYS
+// Flanks restart the timer, so the delay is added to the time since the last
+// flank at which the previous delay ended.
+void loconet_flank_timer_delay(uint16_t delay_us) {
+  loconet_flank_timer_match += delay_us;
+  loconet_flank_timer->COUNT16.CC[1].reg = loconet_flank_timer_match;
+}
+
+//-----------------------------------------------------------------------------
+// Loconet is busy again, delays start at the last flank
+void loconet_flank_timer_restart(void) {
+  EIC->INTENCLR.reg = EIC_EVCTRL_EXTINTEO(loconet_flank_interrupt);
+  loconet_flank_timer_match = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Loconet is idle, interrupt on the next flank
+void loconet_hw_wait_for_flank(void) {
+  EIC->INTFLAG.reg = EIC_EVCTRL_EXTINTEO(loconet_flank_interrupt);
+  EIC->INTENSET.reg = EIC_EVCTRL_EXTINTEO(loconet_flank_interrupt);
+}
+#else
 void loconet_flank_timer_delay(uint16_t delay_us) {
   // Set timer counter to 0
   loconet_flank_timer->COUNT16.COUNT.reg = 0;
@@ -219,6 +318,7 @@ void loconet_flank_timer_delay(uint16_t delay_us) {
   // Enable timer
   loconet_flank_timer->COUNT16.CTRLA.reg |= TC_CTRLA_ENABLE;
 }
+#endif
 
 //-----------------------------------------------------------------------------
 // Enable RX/TX
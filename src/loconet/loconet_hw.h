@@ -18,6 +18,7 @@
 #include "hal_gpio.h"
 #include "loconet_rx.h"
 #include "loconet_tx.h"
+#include "utils/profile.h"
 
 //-----------------------------------------------------------------------------
 // Give a warning if F_CPU is not 8MHz
@@ -25,6 +26,27 @@
 #warn "F_CPU is not 8000000, CD and BREAK timer wont work as expected!"
 #endif
 
+//-----------------------------------------------------------------------------
+// With LOCONET_FLANK_EVSYS defined, flanks on the flank pin restart the flank
+// timer through the event system. Only the first flank after loconet became
+// idle gives an interrupt, the timer interrupts when a delay has passed.
+// Define the event system channel to use with LOCONET_FLANK_EVSYS_CHANNEL.
+#ifdef LOCONET_FLANK_EVSYS
+#ifndef LOCONET_FLANK_EVSYS_CHANNEL
+#define LOCONET_FLANK_EVSYS_CHANNEL 0
+#endif
+#endif
+
+//-----------------------------------------------------------------------------
+// Number of interrupts since startup, to measure interrupt rates
+typedef struct {
+  uint32_t flank;   // Flank pin (EIC)
+  uint32_t timer;   // Flank timer
+  uint32_t sercom;  // Usart
+} LOCONET_IRQ_STATS_Type;
+
+extern volatile LOCONET_IRQ_STATS_Type loconet_irq_stats;
+
 //-----------------------------------------------------------------------------
 // Initializations
 extern void loconet_init(void);
@@ -32,6 +54,9 @@ extern void loconet_init_usart(Sercom*, uint32_t, uint32_t, uint32_t, uint8_t, u
 extern void loconet_init_flank_detection(uint8_t);
 extern void loconet_init_flank_timer(Tc*, uint32_t, uint32_t, uint32_t);
 extern void loconet_save_tx_pin(PortGroup*, uint32_t);
+#ifdef LOCONET_FLANK_EVSYS
+extern void loconet_init_flank_event(uint8_t, uint8_t);
+#endif
 
 //-----------------------------------------------------------------------------
 // IRQ for sercom
@@ -40,6 +65,10 @@ extern void loconet_irq_sercom(void);
 //-----------------------------------------------------------------------------
 // Hardware actions
 extern void loconet_flank_timer_delay(uint16_t);
+#ifdef LOCONET_FLANK_EVSYS
+extern void loconet_flank_timer_restart(void);
+extern void loconet_hw_wait_for_flank(void);
+#endif
 extern void loconet_hw_enable_rx_tx(void);
 extern void loconet_hw_disable_rx_tx(void);
 extern void loconet_hw_force_tx_high(void);
@@ -50,6 +79,46 @@ extern void loconet_hw_enable_transmit(void);
 extern void loconet_activity_led_on(void);
 extern void loconet_activity_led_off(void);
 
+//-----------------------------------------------------------------------------
+// Parts of LOCONET_BUILD which depend on LOCONET_FLANK_EVSYS
+#ifdef LOCONET_FLANK_EVSYS
+#define LOCONET_BUILD_FLANK_EVENT(fl_int, fl_tmr)                             \
+  loconet_init_flank_event(fl_int, EVSYS_ID_USER_TC##fl_tmr##_EVU)
+
+#define LOCONET_BUILD_FLANK()                                                 \
+  loconet_irq_flank_start()
+
+#define LOCONET_BUILD_FLANK_TIMER(fl_tmr)                                     \
+  /* Timer keeps running, flanks restart it */                                \
+  uint8_t flags = TC##fl_tmr->COUNT16.INTFLAG.reg;                            \
+  TC##fl_tmr->COUNT16.INTFLAG.reg = flags & TC_INTFLAG_MC(3);                 \
+  if (HAL_GPIO_LOCONET_FL_read()) {                                           \
+    if (flags & TC_INTFLAG_MC(2)) {                                           \
+      loconet_irq_timer();                                                    \
+    }                                                                         \
+  } else if (flags & TC_INTFLAG_MC(1)) {                                      \
+    loconet_irq_line_break();                                                 \
+  }
+#else
+#define LOCONET_BUILD_FLANK_EVENT(fl_int, fl_tmr)
+
+#define LOCONET_BUILD_FLANK()                                                 \
+  /* Determine RISE / FALL */                                                 \
+  if (HAL_GPIO_LOCONET_FL_read()) {                                           \
+    loconet_irq_flank_rise();                                                 \
+  } else {                                                                    \
+    loconet_irq_flank_fall();                                                 \
+  }
+
+#define LOCONET_BUILD_FLANK_TIMER(fl_tmr)                                     \
+  /* Disable timer */                                                         \
+  TC##fl_tmr->COUNT16.CTRLA.bit.ENABLE = 0;                                   \
+  /* Reset clock interrupt flag */                                            \
+  TC##fl_tmr->COUNT16.INTFLAG.reg = TC_INTFLAG_MC(1);                         \
+  /* Handle loconet timer */                                                  \
+  loconet_irq_timer()
+#endif
+
 // Macro for loconet_init and irq_handler_sercom<nr>
 #define LOCONET_BUILD(                                                        \
     pmux, sercom, tx_pad, rx_pad,                                             \
@@ -80,6 +149,8 @@ extern void loconet_activity_led_off(void);
     /* Set Tx and Rx LED as output */                                         \
     HAL_GPIO_LOCONET_LED_out();                                               \
     HAL_GPIO_LOCONET_LED_clr();                                               \
+    /* Determine which messages are handled */                                \
+    loconet_rx_init();                                                        \
     /* Initialize usart */                                                    \
     loconet_init_usart(                                                       \
       SERCOM##sercom,                                                         \
@@ -93,6 +164,7 @@ extern void loconet_activity_led_off(void);
     loconet_init_flank_detection(                                             \
       fl_int                                                                  \
     );                                                                        \
+    LOCONET_BUILD_FLANK_EVENT(fl_int, fl_tmr);                                \
     /* Initialize flank timer */                                              \
     loconet_init_flank_timer(                                                 \
       TC##fl_tmr,                                                             \
@@ -113,29 +185,25 @@ extern void loconet_activity_led_off(void);
     }                                                                         \
     /* Reset flag */                                                          \
     EIC->INTFLAG.reg |= EIC_INTFLAG_EXTINT##fl_int;                           \
-    /* Determine RISE / FALL */                                               \
-    if (HAL_GPIO_LOCONET_FL_read()) {                                         \
-      loconet_irq_flank_rise();                                               \
-    } else {                                                                  \
-      loconet_irq_flank_fall();                                               \
-    }                                                                         \
+    loconet_irq_stats.flank++;                                                \
+    LOCONET_BUILD_FLANK();                                                    \
     return 1;                                                                 \
   }                                                                           \
   /* Handle timer interrupt */                                                \
   void irq_handler_tc##fl_tmr(void);                                          \
   void irq_handler_tc##fl_tmr(void) {                                         \
-    /* Disable timer */                                                       \
-    TC##fl_tmr->COUNT16.CTRLA.bit.ENABLE = 0;                                 \
-    /* Reset clock interrupt flag */                                          \
-    TC##fl_tmr->COUNT16.INTFLAG.reg = TC_INTFLAG_MC(1);                       \
-    /* Handle loconet timer */                                                \
-    loconet_irq_timer();                                                      \
+    PROFILE_ENTER(PROFILE_FLANK_TIMER);                                       \
+    loconet_irq_stats.timer++;                                                \
+    LOCONET_BUILD_FLANK_TIMER(fl_tmr);                                        \
+    PROFILE_EXIT(PROFILE_FLANK_TIMER);                                        \
   }                                                                           \
   /* Handle received bytes */                                                 \
   void irq_handler_sercom##sercom(void);                                      \
   void irq_handler_sercom##sercom(void)                                       \
   {                                                                           \
+    PROFILE_ENTER(PROFILE_SERCOM);                                            \
     loconet_irq_sercom();                                                     \
+    PROFILE_EXIT(PROFILE_SERCOM);                                             \
   }                                                                           \
   void loconet_activity_led_on(void)                                          \
   {                                                                           \
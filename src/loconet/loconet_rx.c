@@ -10,6 +10,9 @@
  */
 
 #include "loconet_rx.h"
+#include "loconet_filter.h"
+#include "utils/ringbuffer.h"
+#include "utils/trace.h"
 
 //-----------------------------------------------------------------------------
 // Prototypes
@@ -24,29 +27,400 @@ void loconet_rx_dummy_n(uint8_t*, uint8_t);
 #define LOCONET_RX_RINGBUFFER_Size 64
 #endif
 
+RINGBUFFER_BUILD(loconet_rx_ringbuffer, LOCONET_RX_RINGBUFFER_Size);
+
+// Set while the reader is handling the message at the reader
+static volatile uint8_t loconet_rx_claimed = 0;
+
+volatile LOCONET_RX_STATS_Type loconet_rx_stats = { 0, 0, 0, 0, 0, 0, 0 };
+
+//-----------------------------------------------------------------------------
+// Opcodes which have a handler or a listener, one bit per opcode (0x80 -
+// 0xFF). Messages with other opcodes are skipped while they are received.
+// All opcodes are received until loconet_rx_init has determined which
+// handlers are used.
+static uint32_t loconet_rx_interest[4] = {
+  0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF
+};
+// Opcodes which have an overridden handler
+static uint32_t loconet_rx_handled[4] = { 0, 0, 0, 0 };
+// Opcodes which have a listener
+static uint32_t loconet_rx_listening[4] = { 0, 0, 0, 0 };
+
+//-----------------------------------------------------------------------------
+// Listeners registered at runtime
+#ifndef LOCONET_RX_LISTENERS
+#define LOCONET_RX_LISTENERS 4
+#endif
+
+static LOCONET_RX_LISTENER_Type loconet_rx_listeners[LOCONET_RX_LISTENERS];
+
+#ifdef LOCONET_TX_ECHO
+// Set while a message sent by this node is dispatched
+static uint8_t loconet_rx_local = 0;
+#endif
+
+//-----------------------------------------------------------------------------
+// Messages longer than half of the ringbuffer might never fit in it. These
+// messages are received in a separate buffer, the ringbuffer then holds the
+// opcode followed by a length of 0 to keep the order of the messages. Nodes
+// short on RAM can define LOCONET_RX_LONG_MESSAGES as 0, messages which do
+// not fit in the ringbuffer are then skipped.
+#ifndef LOCONET_RX_LONG_MESSAGES
+#define LOCONET_RX_LONG_MESSAGES 1
+#endif
+
+#if LOCONET_RX_LONG_MESSAGES
+#define LOCONET_RX_LONG_MESSAGE_Size 128
+#define LOCONET_RX_MESSAGE_MAX (LOCONET_RX_RINGBUFFER_Size / 2)
+
+static uint8_t loconet_rx_long_message[LOCONET_RX_LONG_MESSAGE_Size];
+// Set while the long message buffer holds a message
+static volatile uint8_t loconet_rx_long_message_used = 0;
+#else
+#define LOCONET_RX_MESSAGE_MAX LOCONET_RX_RINGBUFFER_Size
+#endif
+
+//-----------------------------------------------------------------------------
+typedef union {
+  struct {
+    uint8_t NUMBER:5;
+    uint8_t OPCODE:3;
+  } bits;
+  uint8_t byte;
+} LOCONET_OPCODE_BYTE_Type;
+
+#define LOCONET_OPCODE_FLAG_Pos 7
+#define LOCONET_OPCODE_FLAG (0x01ul << LOCONET_OPCODE_FLAG_Pos)
+
+//-----------------------------------------------------------------------------
+// Message which is being received. Its bytes are written after the writer of
+// the ringbuffer, the writer is only advanced when the message is complete
+// and has a valid checksum. This way the ringbuffer only holds messages which
+// are ready to be handled.
+//
+// Messages are never split over the end of the ringbuffer, so they can be
+// handled in place. If a message does not fit before the end of the buffer,
+// the bytes up to the end are skipped (padding). The padding is marked by a
+// byte without the opcode flag.
 typedef struct {
-  uint8_t buffer[LOCONET_RX_RINGBUFFER_Size];
-  volatile uint8_t writer;
-  volatile uint8_t reader;
-} LOCONET_RX_RINGBUFFER_Type;
+  uint8_t opcode;   // Opcode of the message, 0 if we are waiting for an opcode
+  uint8_t length;   // Length of the message, 0 if it is not known yet
+  uint8_t padding;  // Bytes skipped at the end of the buffer
+  uint8_t index;    // Bytes written
+  uint8_t checksum; // Checksum of the written bytes
+  uint8_t is_long;  // Message is written in the long message buffer
+} LOCONET_RX_FRAME_Type;
+
+static LOCONET_RX_FRAME_Type loconet_rx_frame = { 0, 0, 0, 0, 0, 0 };
+
+_Static_assert(LOCONET_RX_RINGBUFFER_Size <= 256, "LOCONET_RX_RINGBUFFER_Size should be at most 256");
+
+//-----------------------------------------------------------------------------
+// Size of a message based on its opcode, 0 for variable length messages
+static inline uint8_t loconet_rx_message_size(uint8_t byte)
+{
+  LOCONET_OPCODE_BYTE_Type opcode;
+  opcode.byte = byte;
+
+  switch (opcode.bits.OPCODE) {
+    case 0x04:
+      return 2;
+    case 0x05:
+      return 4;
+    case 0x06:
+      return 6;
+    default:
+      return 0;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Size of the message at index in the ringbuffer, returns 0 if the message is
+// in the long message buffer.
+static inline uint8_t loconet_rx_buffer_message_size(uint32_t index)
+{
+  uint8_t size = loconet_rx_message_size(*ringbuffer_at(&loconet_rx_ringbuffer, index));
+  if (!size) {
+    size = *ringbuffer_at(&loconet_rx_ringbuffer, index + 1);
+  }
+  return size;
+}
+
+//-----------------------------------------------------------------------------
+// Bytes used in the ringbuffer by the message at index
+static inline uint8_t loconet_rx_buffer_slot_size(uint32_t index)
+{
+  uint8_t size = loconet_rx_buffer_message_size(index);
+  return size ? size : 2;
+}
+
+//-----------------------------------------------------------------------------
+// Padding before the message at index in the ringbuffer
+static inline uint8_t loconet_rx_buffer_padding(uint32_t index)
+{
+  if (*ringbuffer_at(&loconet_rx_ringbuffer, index) & LOCONET_OPCODE_FLAG) {
+    return 0;
+  }
+  return ringbuffer_size(&loconet_rx_ringbuffer) - (index & loconet_rx_ringbuffer.mask);
+}
+
+//-----------------------------------------------------------------------------
+// Number of bytes available after the last complete message
+static inline uint32_t loconet_rx_buffer_available(void)
+{
+  return ringbuffer_free(&loconet_rx_ringbuffer);
+}
+
+//-----------------------------------------------------------------------------
+// Skip a message which does not fit in the ringbuffer. A message which does
+// not even fit in an empty ringbuffer is oversize, otherwise it is dropped.
+static inline void loconet_rx_frame_overflow(LOCONET_RX_FRAME_Type *frame)
+{
+  if (frame->padding + frame->length > ringbuffer_size(&loconet_rx_ringbuffer)) {
+    loconet_rx_stats.oversize++;
+  } else {
+    loconet_rx_stats.dropped++;
+  }
+  frame->opcode = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Make room for a message of length bytes once its length is known, returns
+// 0 if the message has to be dropped.
+static inline uint8_t loconet_rx_buffer_reserve(uint32_t length)
+{
+  // Never fits, don't drop other messages for it
+  if (length > ringbuffer_size(&loconet_rx_ringbuffer)) {
+    loconet_rx_stats.oversize++;
+    return 0;
+  }
+#if LOCONET_RX_OVERFLOW == LOCONET_RX_OVERFLOW_DROP_OLDEST
+  // Drop the oldest messages, unless the reader is handling it
+  while (length > loconet_rx_buffer_available() && !loconet_rx_claimed) {
+    uint32_t reader = loconet_rx_ringbuffer.reader;
+    if (reader == loconet_rx_ringbuffer.writer) {
+      break;
+    }
+    uint8_t padding = loconet_rx_buffer_padding(reader);
+#if LOCONET_RX_LONG_MESSAGES
+    if (!loconet_rx_buffer_message_size(reader + padding)) {
+      loconet_rx_long_message_used = 0;
+    }
+#endif
+    ringbuffer_release(&loconet_rx_ringbuffer, padding + loconet_rx_buffer_slot_size(reader + padding));
+    loconet_rx_stats.dropped++;
+  }
+#endif
+#if LOCONET_RX_OVERFLOW != LOCONET_RX_OVERFLOW_RESYNC
+  if (length > loconet_rx_buffer_available()) {
+    loconet_rx_stats.dropped++;
+    return 0;
+  }
+#else
+  (void)length;
+#endif
+  return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Write the next byte of the message, the message is dropped if the byte
+// does not fit in the ringbuffer.
+static inline uint8_t loconet_rx_frame_write(LOCONET_RX_FRAME_Type *frame, uint8_t byte)
+{
+#if LOCONET_RX_LONG_MESSAGES
+  if (frame->is_long) {
+    loconet_rx_long_message[frame->index] = byte;
+  } else
+#endif
+  {
+    uint32_t position = frame->padding + frame->index;
+    if (position >= loconet_rx_buffer_available()) {
+      loconet_rx_frame_overflow(frame);
+      return 0;
+    }
+    *ringbuffer_at(&loconet_rx_ringbuffer, loconet_rx_ringbuffer.writer + position) = byte;
+  }
+
+  frame->checksum ^= byte;
+  frame->index++;
+  return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Place the message in the ringbuffer once its length is known and write its
+// opcode.
+static inline uint8_t loconet_rx_frame_start(LOCONET_RX_FRAME_Type *frame)
+{
+  frame->is_long = 0;
+
+  // Message does not fit in the ringbuffer
+  if (frame->length > LOCONET_RX_MESSAGE_MAX) {
+#if LOCONET_RX_LONG_MESSAGES
+    // Only one long message can wait to be handled
+    if (loconet_rx_long_message_used) {
+      loconet_rx_stats.dropped++;
+      frame->opcode = 0;
+      return 0;
+    }
+    frame->is_long = 1;
+    return loconet_rx_frame_write(frame, frame->opcode);
+#else
+    loconet_rx_stats.oversize++;
+    frame->opcode = 0;
+    return 0;
+#endif
+  }
+
+  uint32_t offset = loconet_rx_ringbuffer.writer & loconet_rx_ringbuffer.mask;
+  uint32_t size = ringbuffer_size(&loconet_rx_ringbuffer);
+
+  frame->padding = (offset + frame->length > size) ? size - offset : 0;
+  if (!loconet_rx_buffer_reserve(frame->padding + frame->length)) {
+    frame->opcode = 0;
+    return 0;
+  }
 
-static LOCONET_RX_RINGBUFFER_Type loconet_rx_ringbuffer = { { 0 }, 0, 0};
+  return loconet_rx_frame_write(frame, frame->opcode);
+}
 
 //-----------------------------------------------------------------------------
+// Make a complete message available to the reader, returns 0 if the message
+// has to be dropped.
+static inline uint8_t loconet_rx_frame_commit(LOCONET_RX_FRAME_Type *frame)
+{
+#if LOCONET_RX_LONG_MESSAGES
+  // Place the opcode followed by a length of 0 in the ringbuffer
+  if (frame->is_long) {
+    uint32_t offset = loconet_rx_ringbuffer.writer & loconet_rx_ringbuffer.mask;
+    frame->is_long = 0;
+    frame->length = 2;
+    frame->index = 0;
+    frame->padding = (offset + 2 > ringbuffer_size(&loconet_rx_ringbuffer)) ? 1 : 0;
+    if (!loconet_rx_buffer_reserve(frame->padding + 2)
+        || !loconet_rx_frame_write(frame, frame->opcode)
+        || !loconet_rx_frame_write(frame, 0)) {
+      return 0;
+    }
+    loconet_rx_long_message_used = 1;
+  }
+#endif
+
+  // Mark the padding at the end of the buffer
+  if (frame->padding) {
+    *ringbuffer_at(&loconet_rx_ringbuffer, loconet_rx_ringbuffer.writer) = 0x00;
+  }
+  ringbuffer_commit(&loconet_rx_ringbuffer, frame->padding + frame->length);
+  return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Bit of an opcode in a set of opcodes
+static inline uint8_t loconet_rx_opcode_get(uint32_t *opcodes, uint8_t opcode)
+{
+  return (opcodes[(opcode >> 5) & 0x03] >> (opcode & 0x1F)) & 0x01;
+}
+
+static inline void loconet_rx_opcode_set(uint32_t *opcodes, uint8_t opcode, uint8_t value)
+{
+  uint32_t mask = 1ul << (opcode & 0x1F);
+  if (value) {
+    opcodes[(opcode >> 5) & 0x03] |= mask;
+  } else {
+    opcodes[(opcode >> 5) & 0x03] &= ~mask;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Is there a handler or listener for messages with this opcode?
+static inline uint8_t loconet_rx_is_interesting(uint8_t opcode)
+{
+  return loconet_rx_opcode_get(loconet_rx_interest, opcode);
+}
+
+//-----------------------------------------------------------------------------
+// Handle a received byte, called from the sercom interrupt
 void loconet_rx_buffer_push(uint8_t byte)
 {
-  // Get index + 1 of buffer head
-  uint8_t index = (loconet_rx_ringbuffer.writer + 1) % LOCONET_RX_RINGBUFFER_Size;
+  LOCONET_RX_FRAME_Type *frame = &loconet_rx_frame;
+
+  if (byte & LOCONET_OPCODE_FLAG) {
+    // Start of a new message, an unfinished message is dropped
+    if (frame->opcode) {
+      loconet_rx_stats.resync++;
+    }
+    // Nobody handles the message, skip until the next opcode
+    if (!loconet_rx_is_interesting(byte)) {
+      loconet_rx_stats.ignored++;
+      frame->opcode = 0;
+      return;
+    }
+    frame->opcode = byte;
+    frame->length = loconet_rx_message_size(byte);
+    frame->index = 0;
+    frame->checksum = 0xFF;
+    // Variable length messages are placed once we know their length
+    if (frame->length) {
+      loconet_rx_frame_start(frame);
+    }
+    return;
+  } else if (!frame->opcode) {
+    // Not in a message, skip until the next opcode
+    return;
+  } else if (!frame->length) {
+    // Second byte of a variable length message is its length, the message
+    // should contain at least the opcode, length and checksum.
+    if (byte < 3) {
+      loconet_rx_stats.resync++;
+      frame->opcode = 0;
+      return;
+    }
+    frame->length = byte;
+    if (!loconet_rx_frame_start(frame)) {
+      return;
+    }
+  }
+
+  if (!loconet_rx_frame_write(frame, byte)) {
+    return;
+  }
 
-  // If the buffer is full, wait until the reader empties
-  // a slot in the buffer to write to.
-  while (index == loconet_rx_ringbuffer.reader) {
-    continue;
+  // Is the message complete?
+  if (frame->index == frame->length) {
+    // Only pass messages with a valid checksum
+    trace_event(TRACE_RX, frame->opcode, frame->length, !frame->checksum);
+    if (!frame->checksum) {
+      if (loconet_rx_frame_commit(frame)) {
+        loconet_rx_stats.received++;
+      }
+    } else {
+      loconet_rx_stats.checksum++;
+    }
+    frame->opcode = 0;
   }
+}
 
-  // Write the byte
-  loconet_rx_ringbuffer.buffer[loconet_rx_ringbuffer.writer] = byte;
-  loconet_rx_ringbuffer.writer = index;
+//-----------------------------------------------------------------------------
+uint16_t loconet_rx_buffer_level(void)
+{
+  return ringbuffer_used(&loconet_rx_ringbuffer);
+}
+
+//-----------------------------------------------------------------------------
+uint16_t loconet_rx_buffer_high_watermark(void)
+{
+  return loconet_rx_ringbuffer.high_watermark;
+}
+
+//-----------------------------------------------------------------------------
+// Bytes got lost before they could be read, drop the incomplete message
+void loconet_rx_buffer_overrun(void)
+{
+  loconet_rx_stats.overrun++;
+  if (loconet_rx_frame.opcode) {
+    loconet_rx_stats.resync++;
+    loconet_rx_frame.opcode = 0;
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -102,6 +476,9 @@ static void loconet_rx_wr_sl_data_(uint8_t*, uint8_t);
 static void loconet_rx_rd_sl_data_(uint8_t*, uint8_t);
 static void loconet_rx_peer_xfer_(uint8_t*, uint8_t);
 static void loconet_rx_imm_packet_(uint8_t*, uint8_t);
+static void loconet_rx_sw_req_(uint8_t, uint8_t);
+static void loconet_rx_sw_rep_(uint8_t, uint8_t);
+static void loconet_rx_input_rep_(uint8_t, uint8_t);
 
 //-----------------------------------------------------------------------------
 void (* const ln_messages_0[32])(void) = {
@@ -157,9 +534,9 @@ void (* const ln_messages_2[32])(uint8_t, uint8_t) = {
   loconet_rx_dummy_2,     // 0xAD
   loconet_rx_dummy_2,     // 0xAE
   loconet_rx_dummy_2,     // 0xAF
-  loconet_rx_sw_req,      // 0xB0
-  loconet_rx_sw_rep,      // 0xB1
-  loconet_rx_input_rep,   // 0xB2
+  loconet_rx_sw_req_,     // 0xB0
+  loconet_rx_sw_rep_,     // 0xB1
+  loconet_rx_input_rep_,  // 0xB2
   loconet_rx_dummy_2,     // 0xB3
   loconet_rx_long_ack,    // 0xB4
   loconet_rx_slot_stat1,  // 0xB5
@@ -271,6 +648,30 @@ static void loconet_rx_wr_sl_data_(uint8_t *data, uint8_t length) {
   }
 }
 
+//-----------------------------------------------------------------------------
+// Switch request (OPC_SW_REQ)
+// Pass owned addresses to the filter
+static void loconet_rx_sw_req_(uint8_t sw1, uint8_t sw2) {
+  loconet_rx_sw_req(sw1, sw2);
+  loconet_filter_sw_req(sw1, sw2);
+}
+
+//-----------------------------------------------------------------------------
+// Switch report (OPC_SW_REP)
+// Pass owned addresses to the filter
+static void loconet_rx_sw_rep_(uint8_t sn1, uint8_t sn2) {
+  loconet_rx_sw_rep(sn1, sn2);
+  loconet_filter_sw_rep(sn1, sn2);
+}
+
+//-----------------------------------------------------------------------------
+// Sensor report (OPC_INPUT_REP)
+// Pass owned addresses to the filter
+static void loconet_rx_input_rep_(uint8_t in1, uint8_t in2) {
+  loconet_rx_input_rep(in1, in2);
+  loconet_filter_input_rep(in1, in2);
+}
+
 //-----------------------------------------------------------------------------
 // Fix most significant bits for LNCV messages from an IntelliBox
 static void loconet_fix_msb(uint8_t msb, uint8_t *data, uint8_t length)
@@ -309,94 +710,129 @@ static void loconet_rx_imm_packet_(uint8_t *data, uint8_t length) {
 }
 
 //-----------------------------------------------------------------------------
-typedef union {
-  struct {
-    uint8_t NUMBER:5;
-    uint8_t OPCODE:3;
-  } bits;
-  uint8_t byte;
-} LOCONET_OPCODE_BYTE_Type;
-
-#define LOCONET_OPCODE_FLAG_Pos 7
-#define LOCONET_OPCODE_FLAG (0x01ul << LOCONET_OPCODE_FLAG_Pos)
+// Mark an opcode as handled if its handler is overridden
+static void loconet_rx_interest_set(uint8_t opcode, uint8_t is_interesting)
+{
+  loconet_rx_opcode_set(loconet_rx_handled, opcode, is_interesting);
+}
 
 //-----------------------------------------------------------------------------
-uint8_t loconet_rx_process(void)
+// Update the opcodes the interrupt receives
+static void loconet_rx_interest_update(void)
 {
-  // Get values from ringbuffer
-  uint8_t *buffer = loconet_rx_ringbuffer.buffer;
-  uint8_t reader = loconet_rx_ringbuffer.reader;
-  uint8_t writer = loconet_rx_ringbuffer.writer;
-
-  // Expect an opcode byte from ringbuffer
-  LOCONET_OPCODE_BYTE_Type opcode;
-  opcode.byte = buffer[reader];
-
-  // If the reader is "ahead" of the writer in the ringbuffer,
-  // add the size of the ringbuffer to the writer for its
-  // fictive index.
-  if (reader > writer) {
-    writer += LOCONET_RX_RINGBUFFER_Size;
+  for (uint8_t index = 0; index < 4; index++) {
+    loconet_rx_interest[index] = loconet_rx_handled[index] | loconet_rx_listening[index];
   }
+}
 
-  if (writer <= reader + 1) {
-    // We want at least two bytes before we try to read the message
-    return 0;
+//-----------------------------------------------------------------------------
+// Determine which opcodes have a handler, messages with other opcodes are
+// skipped while they are received.
+void loconet_rx_init(void)
+{
+  for (uint8_t number = 0; number < 32; number++) {
+    loconet_rx_interest_set(0x80 | number, ln_messages_0[number] != loconet_rx_dummy_0);
+    loconet_rx_interest_set(0xA0 | number, ln_messages_2[number] != loconet_rx_dummy_2);
+    loconet_rx_interest_set(0xC0 | number, ln_messages_4[number] != loconet_rx_dummy_4);
+    loconet_rx_interest_set(0xE0 | number, ln_messages_n[number] != loconet_rx_dummy_n);
   }
 
-  // If it's not an OPCODE byte, skip it
-  if (!(opcode.byte & LOCONET_OPCODE_FLAG)) {
-    loconet_rx_ringbuffer.reader = (reader + 1) % LOCONET_RX_RINGBUFFER_Size;
-    return 0;
-  }
+  // Special handlers are only interesting if one of their targets is
+  loconet_rx_interest_set(0xE7,
+    loconet_rx_rd_sl_data != loconet_rx_dummy_n
+    || loconet_rx_prog_task_final != loconet_rx_dummy_n);
+  loconet_rx_interest_set(0xEF,
+    loconet_rx_wr_sl_data != loconet_rx_dummy_n
+    || loconet_rx_fast_clock != loconet_rx_dummy_n
+    || loconet_rx_prog_task_start != loconet_rx_dummy_n);
+  // Switch and sensor messages are also interesting for the address filter
+  loconet_rx_interest_set(0xB0,
+    loconet_rx_sw_req != loconet_rx_dummy_2 || loconet_filter_is_interesting(0xB0));
+  loconet_rx_interest_set(0xB1,
+    loconet_rx_sw_rep != loconet_rx_dummy_2 || loconet_filter_is_interesting(0xB1));
+  loconet_rx_interest_set(0xB2,
+    loconet_rx_input_rep != loconet_rx_dummy_2 || loconet_filter_is_interesting(0xB2));
+  // Peer transfer and IMM packet carry LNCV messages, which are always handled
+
+  loconet_rx_interest_update();
+}
 
-  // New message
-  uint8_t message_size = 0;
-  switch (opcode.bits.OPCODE) {
-    case 0x04:
-      message_size = 2;
-      break;
-    case 0x05:
-      message_size = 4;
-      break;
-    case 0x06:
-      message_size = 6;
-      break;
-    case 0x07:
-      message_size = buffer[(reader + 1) % LOCONET_RX_RINGBUFFER_Size];
-      break;
+//-----------------------------------------------------------------------------
+enum status_code loconet_rx_listen(uint8_t opcode, LOCONET_RX_LISTENER_Callback callback,
+  uint8_t index, uint8_t mask, uint8_t value)
+{
+  if (!(opcode & LOCONET_OPCODE_FLAG) || !callback) {
+    return STATUS_ERR_INVALID_ARG;
   }
 
-  // Check if the buffer contains no new opcodes (could happen due to colissions)
-  uint8_t index_of_writer_or_eom = writer < (reader + message_size) ? writer : reader + message_size;
-  for (uint8_t index = reader + 1; index < index_of_writer_or_eom; index++) {
-    if (buffer[index % LOCONET_RX_RINGBUFFER_Size] & LOCONET_OPCODE_FLAG) {
-      loconet_rx_ringbuffer.reader = index % LOCONET_RX_RINGBUFFER_Size;
-      return 1; // Read the new message right away
+  for (uint8_t slot = 0; slot < LOCONET_RX_LISTENERS; slot++) {
+    LOCONET_RX_LISTENER_Type *listener = &loconet_rx_listeners[slot];
+    if (listener->callback) {
+      continue;
     }
+    listener->opcode = opcode;
+    listener->index = index;
+    listener->mask = mask;
+    listener->value = value & mask;
+    listener->callback = callback;
+
+    loconet_rx_opcode_set(loconet_rx_listening, opcode, 1);
+    loconet_rx_interest_update();
+    return STATUS_OK;
   }
 
-  // Check if we have all the bytes for this message
-  if (writer < reader + message_size) {
-    return 0;
-  }
+  return STATUS_ERR_NO_MEMORY;
+}
 
-  // Get bytes for passing (and build checksum)
-  uint8_t data[message_size];
-  uint8_t *p_data = data;
-  uint8_t eom_index = reader + message_size;
+//-----------------------------------------------------------------------------
+enum status_code loconet_rx_unlisten(uint8_t opcode, LOCONET_RX_LISTENER_Callback callback)
+{
+  enum status_code result = STATUS_ERR_NOT_FOUND;
+  uint8_t listening = 0;
 
-  for (uint8_t index = reader; index < eom_index; index++) {
-    *p_data++ = buffer[index % LOCONET_RX_RINGBUFFER_Size];
+  for (uint8_t slot = 0; slot < LOCONET_RX_LISTENERS; slot++) {
+    LOCONET_RX_LISTENER_Type *listener = &loconet_rx_listeners[slot];
+    if (!listener->callback || listener->opcode != opcode) {
+      continue;
+    }
+    if (listener->callback == callback) {
+      listener->callback = 0;
+      result = STATUS_OK;
+    } else {
+      listening = 1;
+    }
   }
 
-  // Verify checksum (skip message if failed)
-  if (loconet_calc_checksum(data, message_size)) {
-    loconet_rx_ringbuffer.reader = (reader + message_size) % LOCONET_RX_RINGBUFFER_Size;
-    return 0;
+  loconet_rx_opcode_set(loconet_rx_listening, opcode, listening);
+  loconet_rx_interest_update();
+  return result;
+}
+
+//-----------------------------------------------------------------------------
+// Pass a message to the listeners of its opcode, a search over all slots
+// (LOCONET_RX_LISTENERS is small)
+static void loconet_rx_notify(uint8_t *message, uint8_t length)
+{
+  for (uint8_t slot = 0; slot < LOCONET_RX_LISTENERS; slot++) {
+    LOCONET_RX_LISTENER_Type *listener = &loconet_rx_listeners[slot];
+    if (!listener->callback || listener->opcode != message[0]) {
+      continue;
+    }
+    if (listener->mask
+        && (listener->index >= length || (message[listener->index] & listener->mask) != listener->value)) {
+      continue;
+    }
+    listener->callback(message, length);
   }
+}
+
+//-----------------------------------------------------------------------------
+// Call the handler and the listeners of a message
+static void loconet_rx_dispatch(uint8_t *data, uint8_t message_size)
+{
+  LOCONET_OPCODE_BYTE_Type opcode;
+  opcode.byte = data[0];
 
-  // Handle message
   switch(opcode.bits.OPCODE) {
     case 0x04: // Length 0
       (*ln_messages_0[opcode.bits.NUMBER])();
@@ -412,8 +848,72 @@ uint8_t loconet_rx_process(void)
       break;
   }
 
-  // Advance reader
-  loconet_rx_ringbuffer.reader = (reader + message_size) % LOCONET_RX_RINGBUFFER_Size;
+  // Only look for listeners if the opcode has one
+  if (loconet_rx_opcode_get(loconet_rx_listening, opcode.byte)) {
+    loconet_rx_notify(data, message_size);
+  }
+}
+
+#ifdef LOCONET_TX_ECHO
+//-----------------------------------------------------------------------------
+uint8_t loconet_rx_is_local(void)
+{
+  return loconet_rx_local;
+}
+
+//-----------------------------------------------------------------------------
+void loconet_rx_dispatch_local(uint8_t *message, uint8_t length)
+{
+  if (!loconet_rx_is_interesting(message[0])) {
+    return;
+  }
+  loconet_rx_local = 1;
+  loconet_rx_dispatch(message, length);
+  loconet_rx_local = 0;
+}
+#endif
+
+//-----------------------------------------------------------------------------
+uint8_t loconet_rx_process(void)
+{
+#if LOCONET_RX_OVERFLOW == LOCONET_RX_OVERFLOW_DROP_OLDEST
+  // Claim the message, so the interrupt does not drop it while we handle it
+  __disable_irq();
+  uint32_t reader = loconet_rx_ringbuffer.reader;
+  loconet_rx_claimed = 1;
+  __enable_irq();
+#else
+  uint32_t reader = loconet_rx_ringbuffer.reader;
+#endif
+
+  // The ringbuffer only contains complete messages with a valid checksum
+  if (reader == loconet_rx_ringbuffer.writer) {
+    loconet_rx_claimed = 0;
+    return 0;
+  }
+
+  // Handle the message in place, skip the padding if there is any
+  uint8_t padding = loconet_rx_buffer_padding(reader);
+  uint8_t *data = ringbuffer_at(&loconet_rx_ringbuffer, reader + padding);
+  uint8_t message_size = loconet_rx_buffer_message_size(reader + padding);
+#if LOCONET_RX_LONG_MESSAGES
+  // Message is in the long message buffer
+  if (!message_size) {
+    data = loconet_rx_long_message;
+    message_size = data[1];
+  }
+#endif
+
+  loconet_rx_dispatch(data, message_size);
+
+  // Release the message
+#if LOCONET_RX_LONG_MESSAGES
+  if (data == loconet_rx_long_message) {
+    loconet_rx_long_message_used = 0;
+  }
+#endif
+  ringbuffer_release(&loconet_rx_ringbuffer, padding + loconet_rx_buffer_slot_size(reader + padding));
+  loconet_rx_claimed = 0;
 
   // Return that we have processed a message
   return 1;
@@ -16,8 +16,81 @@
 
 #include <stdint.h>
 #include "loconet_cv.h"
+#include "utils/status_codes.h"
 
+//-----------------------------------------------------------------------------
+// What to do with a received message when the ringbuffer is full:
+// - RESYNC:      drop the message when a byte does not fit and wait for the
+//                next opcode
+// - DROP_NEWEST: drop the message if it does not fit once its length is known
+// - DROP_OLDEST: drop the oldest messages in the ringbuffer to make room, the
+//                message which is being handled is never dropped
+#define LOCONET_RX_OVERFLOW_RESYNC      0
+#define LOCONET_RX_OVERFLOW_DROP_NEWEST 1
+#define LOCONET_RX_OVERFLOW_DROP_OLDEST 2
+
+#ifndef LOCONET_RX_OVERFLOW
+#define LOCONET_RX_OVERFLOW LOCONET_RX_OVERFLOW_RESYNC
+#endif
+
+//-----------------------------------------------------------------------------
+// Receive statistics, updated from the sercom interrupt
+typedef struct {
+  uint16_t overrun; // Bytes lost because the USART was not read in time
+  uint16_t dropped; // Messages dropped because the ringbuffer was full
+  uint16_t resync;  // Incomplete messages dropped when a new opcode arrived
+  uint16_t oversize; // Messages skipped because they do not fit in the ringbuffer
+  uint16_t ignored;  // Messages skipped because they have no handler
+  uint16_t received; // Messages received with a valid checksum and stored
+  uint16_t checksum; // Messages dropped because of an invalid checksum
+} LOCONET_RX_STATS_Type;
+
+extern volatile LOCONET_RX_STATS_Type loconet_rx_stats;
+
+//-----------------------------------------------------------------------------
+// Listener for received messages, besides the loconet_rx_* handlers. It gets
+// the complete message, starting with the opcode. The message can be
+// filtered on a byte: only messages with
+//
+//     (message[index] & mask) == value
+//
+// are passed to the listener. A mask of 0 passes all messages.
+typedef void (*LOCONET_RX_LISTENER_Callback)(uint8_t *message, uint8_t length);
+
+typedef struct {
+  LOCONET_RX_LISTENER_Callback callback; // 0 if the listener is not used
+  uint8_t opcode;
+  uint8_t index;
+  uint8_t mask;
+  uint8_t value;
+} LOCONET_RX_LISTENER_Type;
+
+//-----------------------------------------------------------------------------
+// Add or remove a listener, at most LOCONET_RX_LISTENERS (default 4) can be
+// added. Messages with an opcode without listeners only cost a bit test, for
+// the other messages all LOCONET_RX_LISTENERS slots are searched. That is
+// cheap for a few listeners, but grows linearly with LOCONET_RX_LISTENERS.
+extern enum status_code loconet_rx_listen(uint8_t opcode, LOCONET_RX_LISTENER_Callback callback,
+  uint8_t index, uint8_t mask, uint8_t value);
+extern enum status_code loconet_rx_unlisten(uint8_t opcode, LOCONET_RX_LISTENER_Callback callback);
+
+//-----------------------------------------------------------------------------
+extern void loconet_rx_init(void);
 extern uint8_t loconet_rx_process(void);
 extern void loconet_rx_buffer_push(uint8_t);
+extern void loconet_rx_buffer_overrun(void);
+
+#ifdef LOCONET_TX_ECHO
+//-----------------------------------------------------------------------------
+// Handle a message sent by this node as if it was received. While its
+// handler and listeners are called, loconet_rx_is_local returns 1.
+extern void loconet_rx_dispatch_local(uint8_t *message, uint8_t length);
+extern uint8_t loconet_rx_is_local(void);
+#endif
+
+//-----------------------------------------------------------------------------
+// Number of bytes in the receive ringbuffer, now and at most
+extern uint16_t loconet_rx_buffer_level(void);
+extern uint16_t loconet_rx_buffer_high_watermark(void);
 
 #endif // _LOCONET_LOCONET_RX_H_
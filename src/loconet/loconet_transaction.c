@@ -0,0 +1,158 @@
+/**
+ * @file loconet_transaction.c
+ * @brief Wait for the response on a request without blocking
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#include "loconet_transaction.h"
+#include "loconet_rx.h"
+#include "utils/timer.h"
+
+//-----------------------------------------------------------------------------
+#define LOCONET_TRANSACTION_LONG_ACK 0xB4
+
+static LOCONET_TRANSACTION_Type loconet_transactions[LOCONET_TRANSACTIONS];
+
+//-----------------------------------------------------------------------------
+// Prototypes
+static void loconet_transaction_receive(uint8_t *message, uint8_t length);
+
+//-----------------------------------------------------------------------------
+// Is there a transaction in flight waiting for opcode?
+static uint8_t loconet_transaction_waiting(uint8_t opcode)
+{
+  for (uint8_t slot = 0; slot < LOCONET_TRANSACTIONS; slot++) {
+    LOCONET_TRANSACTION_Type *transaction = &loconet_transactions[slot];
+    if (transaction->callback && transaction->opcode == opcode) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Free a transaction, the listener is removed when it was the last
+// transaction for its opcode.
+static void loconet_transaction_free(LOCONET_TRANSACTION_Type *transaction)
+{
+  transaction->callback = 0;
+  if (!loconet_transaction_waiting(transaction->opcode)) {
+    loconet_rx_unlisten(transaction->opcode, loconet_transaction_receive);
+  }
+}
+
+//-----------------------------------------------------------------------------
+enum status_code loconet_transaction_start(uint8_t opcode, uint8_t index, uint8_t mask,
+  uint8_t value, uint16_t timeout, LOCONET_TRANSACTION_Callback callback)
+{
+  if (!callback) {
+    return STATUS_ERR_INVALID_ARG;
+  }
+
+  for (uint8_t slot = 0; slot < LOCONET_TRANSACTIONS; slot++) {
+    LOCONET_TRANSACTION_Type *transaction = &loconet_transactions[slot];
+    if (transaction->callback) {
+      continue;
+    }
+
+    // First transaction for this opcode, start listening
+    if (!loconet_transaction_waiting(opcode)) {
+      enum status_code result = loconet_rx_listen(opcode, loconet_transaction_receive, 0, 0, 0);
+      if (result != STATUS_OK) {
+        return result;
+      }
+    }
+
+    transaction->opcode = opcode;
+    transaction->index = index;
+    transaction->mask = mask;
+    transaction->value = value & mask;
+    transaction->timeout = timeout;
+    transaction->start = timer_ms();
+    transaction->callback = callback;
+    return STATUS_OK;
+  }
+
+  return STATUS_ERR_NO_MEMORY;
+}
+
+//-----------------------------------------------------------------------------
+// The long acknowledge holds the opcode of the request without its flag
+enum status_code loconet_transaction_long_ack(uint8_t request_opcode, uint16_t timeout,
+  LOCONET_TRANSACTION_Callback callback)
+{
+  return loconet_transaction_start(LOCONET_TRANSACTION_LONG_ACK, 1, 0x7F, request_opcode, timeout, callback);
+}
+
+//-----------------------------------------------------------------------------
+enum status_code loconet_transaction_cancel(uint8_t opcode, LOCONET_TRANSACTION_Callback callback)
+{
+  for (uint8_t slot = 0; slot < LOCONET_TRANSACTIONS; slot++) {
+    LOCONET_TRANSACTION_Type *transaction = &loconet_transactions[slot];
+    if (transaction->callback == callback && transaction->opcode == opcode) {
+      loconet_transaction_free(transaction);
+      return STATUS_OK;
+    }
+  }
+  return STATUS_ERR_NOT_FOUND;
+}
+
+//-----------------------------------------------------------------------------
+uint8_t loconet_transaction_count(void)
+{
+  uint8_t count = 0;
+  for (uint8_t slot = 0; slot < LOCONET_TRANSACTIONS; slot++) {
+    if (loconet_transactions[slot].callback) {
+      count++;
+    }
+  }
+  return count;
+}
+
+//-----------------------------------------------------------------------------
+// Listener for all opcodes with a transaction, completes the oldest
+// transaction the message is a response to.
+static void loconet_transaction_receive(uint8_t *message, uint8_t length)
+{
+  LOCONET_TRANSACTION_Type *oldest = 0;
+  uint32_t now = timer_ms();
+
+  for (uint8_t slot = 0; slot < LOCONET_TRANSACTIONS; slot++) {
+    LOCONET_TRANSACTION_Type *transaction = &loconet_transactions[slot];
+    if (!transaction->callback || transaction->opcode != message[0]) {
+      continue;
+    }
+    if (transaction->mask
+        && (transaction->index >= length || (message[transaction->index] & transaction->mask) != transaction->value)) {
+      continue;
+    }
+    if (!oldest || now - transaction->start > now - oldest->start) {
+      oldest = transaction;
+    }
+  }
+
+  if (oldest) {
+    // Free the transaction first, so the callback can start a new one
+    LOCONET_TRANSACTION_Callback callback = oldest->callback;
+    loconet_transaction_free(oldest);
+    callback(STATUS_OK, message, length);
+  }
+}
+
+//-----------------------------------------------------------------------------
+void loconet_transaction_process(void)
+{
+  for (uint8_t slot = 0; slot < LOCONET_TRANSACTIONS; slot++) {
+    LOCONET_TRANSACTION_Type *transaction = &loconet_transactions[slot];
+    if (!transaction->callback || timer_elapsed(transaction->start) < transaction->timeout) {
+      continue;
+    }
+    LOCONET_TRANSACTION_Callback callback = transaction->callback;
+    loconet_transaction_free(transaction);
+    callback(STATUS_ERR_TIMEOUT, 0, 0);
+  }
+}
@@ -0,0 +1,82 @@
+/**
+ * @file loconet_transaction.h
+ * @brief Wait for the response on a request without blocking
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * A transaction waits for a message with an expected opcode and an expected
+ * value in one of its bytes, e.g. the long acknowledge (OPC_LONG_ACK) on a
+ * request. When the response is received, or when it did not arrive in
+ * time, the callback of the transaction is called from the main loop:
+ *
+ *     static void my_response(enum status_code status, uint8_t *message, uint8_t length) {
+ *       if (status == STATUS_OK) {
+ *         // message holds the response
+ *       } else {
+ *         // STATUS_ERR_TIMEOUT, message is 0
+ *       }
+ *     }
+ *
+ *     loconet_tx_queue_n(0xED, 1, data, 11);
+ *     loconet_transaction_long_ack(0xED, 500, my_response);
+ *
+ * At most LOCONET_TRANSACTIONS (default 4) transactions can be in flight.
+ * Responses are received using an rx listener, one listener is used per
+ * distinct opcode which is waited for.
+ *
+ * Timeouts are checked in `loconet_transaction_process`, which has to be
+ * called from the main loop, and require the timer (utils/timer.h) to run.
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#ifndef _LOCONET_LOCONET_TRANSACTION_H_
+#define _LOCONET_LOCONET_TRANSACTION_H_
+
+#include <stdint.h>
+#include "utils/status_codes.h"
+
+//-----------------------------------------------------------------------------
+#ifndef LOCONET_TRANSACTIONS
+#define LOCONET_TRANSACTIONS 4
+#endif
+
+//-----------------------------------------------------------------------------
+// Called once per transaction, with STATUS_OK and the response, or with
+// STATUS_ERR_TIMEOUT and no message.
+typedef void (*LOCONET_TRANSACTION_Callback)(enum status_code status, uint8_t *message, uint8_t length);
+
+typedef struct {
+  LOCONET_TRANSACTION_Callback callback; // 0 if the transaction is not used
+  uint32_t start;
+  uint16_t timeout;
+  uint8_t opcode;
+  uint8_t index;
+  uint8_t mask;
+  uint8_t value;
+} LOCONET_TRANSACTION_Type;
+
+//-----------------------------------------------------------------------------
+// Wait at most timeout milliseconds for a message with opcode where
+// (message[index] & mask) == value. Returns STATUS_ERR_NO_MEMORY if all
+// transactions are in flight.
+extern enum status_code loconet_transaction_start(uint8_t opcode, uint8_t index, uint8_t mask,
+  uint8_t value, uint16_t timeout, LOCONET_TRANSACTION_Callback callback);
+
+// Wait for the long acknowledge (OPC_LONG_ACK) on a request
+extern enum status_code loconet_transaction_long_ack(uint8_t request_opcode, uint16_t timeout,
+  LOCONET_TRANSACTION_Callback callback);
+
+// Stop waiting without calling the callback. Returns STATUS_ERR_NOT_FOUND
+// if the transaction is not in flight.
+extern enum status_code loconet_transaction_cancel(uint8_t opcode, LOCONET_TRANSACTION_Callback callback);
+
+//-----------------------------------------------------------------------------
+// Number of transactions in flight
+extern uint8_t loconet_transaction_count(void);
+
+// Complete transactions which timed out
+extern void loconet_transaction_process(void);
+
+#endif // _LOCONET_LOCONET_TRANSACTION_H_
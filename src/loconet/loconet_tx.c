@@ -10,12 +10,28 @@
  */
 
 #include "loconet_tx.h"
+#include "loconet_rx.h"
+#include "utils/timer.h"
+#include "utils/trace.h"
+
+//-----------------------------------------------------------------------------
+// Number of priorities, a message with a higher priority is sent at the
+// lowest priority.
+#define LOCONET_TX_PRIORITIES 16
+
+// A waiting message gains one priority level for every 2^LOCONET_TX_AGING
+// milliseconds it waits, so messages of a low priority are always sent
+// (eventually).
+#ifndef LOCONET_TX_AGING
+#define LOCONET_TX_AGING 5
+#endif
 
 //-----------------------------------------------------------------------------
 // Loconet message/linked list definition
 typedef struct MESSAGE {
   // Control fields
   uint8_t priority;
+  uint32_t queued;   // Time (ms) the message was queued
   struct MESSAGE *next;
   // Message fields
   uint8_t *data;
@@ -23,33 +39,468 @@ typedef struct MESSAGE {
   // Current index we're sending
   uint8_t tx_index;
   uint8_t rx_index;
+  // Number of collisions while sending the message
+  uint8_t retries;
+#ifdef LOCONET_TX_COALESCE
+  // Next waiting report in the same coalesce slot
+  struct MESSAGE *coalesce_next;
+#endif
 } LOCONET_MESSAGE_Type;
 
-static LOCONET_MESSAGE_Type *loconet_tx_queue = 0;
+//-----------------------------------------------------------------------------
+// Queue of messages with the same priority
+typedef struct {
+  LOCONET_MESSAGE_Type *head;
+  LOCONET_MESSAGE_Type *tail;
+  uint8_t count;
+} LOCONET_TX_BUCKET_Type;
+
+static LOCONET_TX_BUCKET_Type loconet_tx_buckets[LOCONET_TX_PRIORITIES];
+// Bit per priority which has messages waiting
+static volatile uint16_t loconet_tx_ready = 0;
+// Number of messages waiting
+static volatile uint16_t loconet_tx_count = 0;
+
 static LOCONET_MESSAGE_Type *loconet_tx_current = 0;
+#ifdef LOCONET_TX_ECHO
+// Message sent without collision, handled as received in loconet_tx_process
+static LOCONET_MESSAGE_Type * volatile loconet_tx_echo = 0;
+#endif
+// Message being filled by the caller of loconet_tx_reserve
+static LOCONET_MESSAGE_Type *loconet_tx_reserved = 0;
+
+//-----------------------------------------------------------------------------
+// Maximum number of waiting messages per priority
+#ifndef LOCONET_TX_CAPACITY
+#define LOCONET_TX_CAPACITY 0xFF
+#endif
+
+static uint8_t loconet_tx_capacity[LOCONET_TX_PRIORITIES] = {
+  [0 ... LOCONET_TX_PRIORITIES - 1] = LOCONET_TX_CAPACITY
+};
+
+//-----------------------------------------------------------------------------
+// Number of retries after which a message is abandoned, 0 to retry forever
+#ifndef LOCONET_TX_RETRIES
+#define LOCONET_TX_RETRIES 0
+#endif
+
+// Highest priority delay (in bit times) after a collision
+#ifndef LOCONET_TX_BACKOFF_MAX
+#define LOCONET_TX_BACKOFF_MAX 20
+#endif
+
+// Extra priority delay (in bit times) before the next attempt
+static volatile uint8_t loconet_tx_backoff_delay = 0;
+// Message which was abandoned by the collision interrupt
+static LOCONET_MESSAGE_Type * volatile loconet_tx_abandoned = 0;
+// State of the random number generator
+static uint16_t loconet_tx_random = 0;
 
 //-----------------------------------------------------------------------------
-// Stop transmission and free memory of the message
+void loconet_tx_abandoned_event_dummy(uint8_t *data, uint8_t length);
+void loconet_tx_abandoned_event_dummy(uint8_t *data, uint8_t length)
+{
+  (void)data;
+  (void)length;
+}
+
+__attribute__ ((weak, alias ("loconet_tx_abandoned_event_dummy"))) \
+  void loconet_tx_abandoned_event(uint8_t *data, uint8_t length);
+
+//-----------------------------------------------------------------------------
+// Set when a message was rejected, changed to ROOM when a message has left
+// the queue since.
+#define LOCONET_TX_ROOM_IDLE   0
+#define LOCONET_TX_ROOM_WANTED 1
+#define LOCONET_TX_ROOM        2
+
+static volatile uint8_t loconet_tx_room = LOCONET_TX_ROOM_IDLE;
+
+//-----------------------------------------------------------------------------
+void loconet_tx_room_event_dummy(void);
+void loconet_tx_room_event_dummy(void)
+{
+}
+
+__attribute__ ((weak, alias ("loconet_tx_room_event_dummy"))) \
+  void loconet_tx_room_event(void);
+
+//-----------------------------------------------------------------------------
+// Messages are taken from fixed pools: small messages (up to 6 bytes) and
+// a few large messages for variable length messages. A pool hands out its
+// messages in order until all have been used once, after that freed
+// messages are reused.
+#ifndef LOCONET_TX_POOL_SMALL
+#define LOCONET_TX_POOL_SMALL 12
+#endif
+
+#ifndef LOCONET_TX_POOL_LARGE
+#define LOCONET_TX_POOL_LARGE 2
+#endif
+
+#ifndef LOCONET_TX_POOL_LARGE_Size
+#define LOCONET_TX_POOL_LARGE_Size 16
+#endif
+
+#define LOCONET_TX_POOL_SMALL_Size 6
+
+typedef struct {
+  LOCONET_MESSAGE_Type *messages;
+  uint8_t *data;
+  uint8_t data_size;          // Bytes per message
+  uint8_t size;               // Number of messages
+  uint8_t unused;             // Messages which have never been used
+  LOCONET_MESSAGE_Type *free; // Freed messages
+  volatile LOCONET_TX_POOL_STATS_Type *stats;
+} LOCONET_TX_POOL_Type;
+
+volatile LOCONET_TX_STATS_Type loconet_tx_stats = { { 0, 0, 0 }, { 0, 0, 0 }, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+static LOCONET_MESSAGE_Type loconet_tx_small_messages[LOCONET_TX_POOL_SMALL];
+static uint8_t loconet_tx_small_data[LOCONET_TX_POOL_SMALL][LOCONET_TX_POOL_SMALL_Size];
+static LOCONET_MESSAGE_Type loconet_tx_large_messages[LOCONET_TX_POOL_LARGE];
+static uint8_t loconet_tx_large_data[LOCONET_TX_POOL_LARGE][LOCONET_TX_POOL_LARGE_Size];
+
+static LOCONET_TX_POOL_Type loconet_tx_small_pool = {
+  loconet_tx_small_messages, &loconet_tx_small_data[0][0], LOCONET_TX_POOL_SMALL_Size,
+  LOCONET_TX_POOL_SMALL, LOCONET_TX_POOL_SMALL, 0, &loconet_tx_stats.small
+};
+
+static LOCONET_TX_POOL_Type loconet_tx_large_pool = {
+  loconet_tx_large_messages, &loconet_tx_large_data[0][0], LOCONET_TX_POOL_LARGE_Size,
+  LOCONET_TX_POOL_LARGE, LOCONET_TX_POOL_LARGE, 0, &loconet_tx_stats.large
+};
+
+_Static_assert(LOCONET_TX_POOL_SMALL > 0 && LOCONET_TX_POOL_SMALL < 256, "LOCONET_TX_POOL_SMALL should be 1 - 255");
+_Static_assert(LOCONET_TX_POOL_LARGE > 0 && LOCONET_TX_POOL_LARGE < 256, "LOCONET_TX_POOL_LARGE should be 1 - 255");
+_Static_assert(LOCONET_TX_POOL_LARGE_Size > LOCONET_TX_POOL_SMALL_Size, "LOCONET_TX_POOL_LARGE_Size should be larger than 6");
+
+//-----------------------------------------------------------------------------
+// The collision interrupt places messages back in the queue, changes to the
+// queue from the main loop should not be interrupted.
+#define LOCONET_TX_CRITICAL_ENTER()                                           \
+  uint32_t loconet_tx_primask = __get_PRIMASK();                              \
+  __disable_irq()
+#define LOCONET_TX_CRITICAL_EXIT()                                            \
+  __set_PRIMASK(loconet_tx_primask)
+
+//-----------------------------------------------------------------------------
+// When LOCONET_TX_COALESCE is defined, a new switch or sensor report for an
+// address which is still waiting replaces the state of the waiting report.
+// Waiting reports are found through a small hash table on their address.
+#ifdef LOCONET_TX_COALESCE
+
+#ifndef LOCONET_TX_COALESCE_Size
+#define LOCONET_TX_COALESCE_Size 8
+#endif
+
+_Static_assert((LOCONET_TX_COALESCE_Size & (LOCONET_TX_COALESCE_Size - 1)) == 0,
+  "LOCONET_TX_COALESCE_Size should be a power of two");
+
+static LOCONET_MESSAGE_Type *loconet_tx_coalesce[LOCONET_TX_COALESCE_Size];
+
+//-----------------------------------------------------------------------------
+// Bits of the second byte which identify the report, 0 if reports with this
+// opcode are not coalesced
+static inline uint8_t loconet_tx_coalesce_mask(uint8_t opcode, uint8_t b)
+{
+  switch (opcode) {
+    case 0xB1: // Switch report: address and type, the input form has an I bit
+      return (b & 0x40) ? 0x6F : 0x4F;
+    case 0xB2: // Sensor report: address and I bit
+      return 0x2F;
+    default:
+      return 0;
+  }
+}
+
+//-----------------------------------------------------------------------------
+static inline LOCONET_MESSAGE_Type **loconet_tx_coalesce_slot(uint8_t a, uint8_t b)
+{
+  return &loconet_tx_coalesce[(a ^ (b << 3)) & (LOCONET_TX_COALESCE_Size - 1)];
+}
+
+//-----------------------------------------------------------------------------
+// Add a waiting message to the hash table if it is a report
+static inline void loconet_tx_coalesce_add(LOCONET_MESSAGE_Type *message)
+{
+  uint8_t mask = loconet_tx_coalesce_mask(message->data[0], message->data[2]);
+  if (message->data_length != 4 || !mask) {
+    return;
+  }
+  LOCONET_MESSAGE_Type **slot = loconet_tx_coalesce_slot(message->data[1], message->data[2] & mask);
+  message->coalesce_next = *slot;
+  *slot = message;
+}
+
+//-----------------------------------------------------------------------------
+// Remove a message from the hash table when it leaves the queue
+static inline void loconet_tx_coalesce_remove(LOCONET_MESSAGE_Type *message)
+{
+  uint8_t mask = loconet_tx_coalesce_mask(message->data[0], message->data[2]);
+  if (message->data_length != 4 || !mask) {
+    return;
+  }
+  LOCONET_MESSAGE_Type **slot = loconet_tx_coalesce_slot(message->data[1], message->data[2] & mask);
+  for (; *slot; slot = &(*slot)->coalesce_next) {
+    if (*slot == message) {
+      *slot = message->coalesce_next;
+      break;
+    }
+  }
+  message->coalesce_next = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Replace the state of a waiting report for the same address, returns 0 if
+// there is none
+static uint8_t loconet_tx_coalesce_replace(uint8_t opcode, uint8_t a, uint8_t b)
+{
+  uint8_t mask = loconet_tx_coalesce_mask(opcode, b);
+  if (!mask) {
+    return 0;
+  }
+  LOCONET_MESSAGE_Type *message = *loconet_tx_coalesce_slot(a, b & mask);
+  for (; message; message = message->coalesce_next) {
+    uint8_t *data = message->data;
+    if (data[0] == opcode && data[1] == a && (data[2] & mask) == (b & mask)) {
+      data[2] = b;
+      data[3] = loconet_calc_checksum(data, 3);
+      loconet_tx_stats.coalesced++;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+#else
+#define loconet_tx_coalesce_add(message) do {} while(0)
+#define loconet_tx_coalesce_remove(message) do {} while(0)
+#endif // LOCONET_TX_COALESCE
+
+//-----------------------------------------------------------------------------
+// Pool for messages of length bytes
+static inline LOCONET_TX_POOL_Type *loconet_tx_pool(uint8_t length)
+{
+  return length <= LOCONET_TX_POOL_SMALL_Size ? &loconet_tx_small_pool : &loconet_tx_large_pool;
+}
+
+//-----------------------------------------------------------------------------
+// Does the pool have a message left?
+static inline uint8_t loconet_tx_pool_available(LOCONET_TX_POOL_Type *pool)
+{
+  return pool->free || pool->unused;
+}
+
+//-----------------------------------------------------------------------------
+// Take a message from its pool, returns 0 if the pool is exhausted
+static inline LOCONET_MESSAGE_Type *loconet_tx_pool_alloc(LOCONET_TX_POOL_Type *pool)
+{
+  LOCONET_MESSAGE_Type *message;
+
+  if (pool->free) {
+    message = pool->free;
+    pool->free = message->next;
+  } else if (pool->unused) {
+    uint8_t index = pool->size - pool->unused--;
+    message = &pool->messages[index];
+    message->data = &pool->data[index * pool->data_size];
+  } else {
+    return 0;
+  }
+
+  if (++pool->stats->used > pool->stats->high_watermark) {
+    pool->stats->high_watermark = pool->stats->used;
+  }
+  return message;
+}
+
+//-----------------------------------------------------------------------------
+// Return a message to its pool, also called from interrupts
+static inline void loconet_tx_pool_free(LOCONET_MESSAGE_Type *message)
+{
+  LOCONET_TX_POOL_Type *pool = loconet_tx_pool(message->data_length);
+  message->next = pool->free;
+  pool->free = message;
+  pool->stats->used--;
+  if (loconet_tx_room == LOCONET_TX_ROOM_WANTED) {
+    loconet_tx_room = LOCONET_TX_ROOM;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Add a message at the end of the queue of its priority
+static inline void loconet_tx_bucket_push(LOCONET_MESSAGE_Type *message)
+{
+  LOCONET_TX_BUCKET_Type *bucket = &loconet_tx_buckets[message->priority];
+  message->next = 0;
+  if (bucket->tail) {
+    bucket->tail->next = message;
+  } else {
+    bucket->head = message;
+  }
+  bucket->tail = message;
+  bucket->count++;
+  loconet_tx_ready |= (1u << message->priority);
+  loconet_tx_count++;
+}
+
+//-----------------------------------------------------------------------------
+// Add a message at the front of the queue of its priority
+static inline void loconet_tx_bucket_push_front(LOCONET_MESSAGE_Type *message)
+{
+  LOCONET_TX_BUCKET_Type *bucket = &loconet_tx_buckets[message->priority];
+  message->next = bucket->head;
+  if (!bucket->tail) {
+    bucket->tail = message;
+  }
+  bucket->head = message;
+  bucket->count++;
+  loconet_tx_ready |= (1u << message->priority);
+  loconet_tx_count++;
+}
+
+//-----------------------------------------------------------------------------
+// Take the first message from the queue of a priority
+static inline LOCONET_MESSAGE_Type *loconet_tx_bucket_pop(uint8_t priority)
+{
+  LOCONET_TX_BUCKET_Type *bucket = &loconet_tx_buckets[priority];
+  LOCONET_MESSAGE_Type *message = bucket->head;
+  bucket->head = message->next;
+  if (!bucket->head) {
+    bucket->tail = 0;
+    loconet_tx_ready &= ~(1u << priority);
+  }
+  message->next = 0;
+  bucket->count--;
+  loconet_tx_count--;
+  loconet_tx_coalesce_remove(message);
+  return message;
+}
+
+//-----------------------------------------------------------------------------
+// Priority of the queue to send from. The first message of each queue gains
+// priority while it waits, of equal priorities the lowest queue wins. There
+// are at most LOCONET_TX_PRIORITIES queues to look at.
+static inline uint8_t loconet_tx_next_priority(void)
+{
+  uint8_t best = 0;
+  int16_t best_priority = INT16_MAX;
+  uint16_t ready = loconet_tx_ready;
+  uint32_t now = timer_ms();
+
+  for (uint8_t priority = 0; ready; priority++, ready >>= 1) {
+    if (!(ready & 0x01)) {
+      continue;
+    }
+    // Once a message gained all levels it can't gain any more
+    uint32_t age = (now - loconet_tx_buckets[priority].head->queued) >> LOCONET_TX_AGING;
+    if (age > LOCONET_TX_PRIORITIES) {
+      age = LOCONET_TX_PRIORITIES;
+    }
+    int16_t effective = (int16_t)priority - (int16_t)age;
+    if (effective < best_priority) {
+      best_priority = effective;
+      best = priority;
+    }
+  }
+
+  return best;
+}
+
+//-----------------------------------------------------------------------------
+// Pseudo random number (xorshift), seeded with our address so nodes which
+// collided pick different delays
+static inline uint16_t loconet_tx_next_random(void)
+{
+  uint16_t x = loconet_tx_random;
+  if (!x) {
+    x = 0xACE1 ^ loconet_config.bit.ADDRESS;
+  }
+  x ^= x << 7;
+  x ^= x >> 9;
+  x ^= x << 8;
+  loconet_tx_random = x;
+  return x;
+}
+
+//-----------------------------------------------------------------------------
+// Stop transmission and return the message to its pool, or keep it to
+// handle it as received with LOCONET_TX_ECHO
 void loconet_tx_stop(void)
 {
   loconet_status.bit.TRANSMIT = 0;
   // We might not have a message due to collision detection
   if (loconet_tx_current) {
-    free(loconet_tx_current->data);
-    free(loconet_tx_current);
+    trace_event(TRACE_TX_END, loconet_tx_current->data[0], loconet_tx_current->data_length, 0);
+    uint32_t wait = timer_ms() - loconet_tx_current->queued;
+    loconet_tx_stats.transmitted++;
+    loconet_tx_stats.wait_total += wait;
+    if (wait > loconet_tx_stats.wait_max) {
+      loconet_tx_stats.wait_max = wait < 0xFFFF ? wait : 0xFFFF;
+    }
+#ifdef LOCONET_TX_ECHO
+    // All bytes were read back, keep the message to handle it as received
+    if (loconet_tx_current->rx_index == loconet_tx_current->data_length) {
+      loconet_tx_echo = loconet_tx_current;
+    } else {
+      loconet_tx_pool_free(loconet_tx_current);
+    }
+#else
+    loconet_tx_pool_free(loconet_tx_current);
+#endif
+    loconet_tx_current = 0;
+    // Sent without collision, no need to back off
+    loconet_tx_backoff_delay = 0;
   }
 }
 
 //-----------------------------------------------------------------------------
+// Called from the collision interrupt
 void loconet_tx_reset_current_message_to_queue(void)
 {
-  // Reset transmit and receive index
-  loconet_tx_current->tx_index = 0;
-  loconet_tx_current->rx_index = 0;
-  // Place message back at front of queue
-  loconet_tx_current->next = loconet_tx_queue;
-  loconet_tx_queue = loconet_tx_current;
+  LOCONET_MESSAGE_Type *message = loconet_tx_current;
+  if (!message) {
+    return;
+  }
   loconet_tx_current = 0;
+
+  if (message->retries < 0xFF) {
+    message->retries++;
+  }
+  loconet_tx_stats.retries++;
+
+  // Back off a random number of bit times, the range doubles with every
+  // retry (up to 16 bit times)
+  uint8_t range = message->retries < 4 ? (1 << message->retries) : 16;
+  loconet_tx_backoff_delay = loconet_tx_next_random() & (range - 1);
+
+#if LOCONET_TX_RETRIES
+  // Give up, the main loop reports and frees the message. It may not be
+  // found for a newer report anymore.
+  if (message->retries > LOCONET_TX_RETRIES) {
+    loconet_tx_coalesce_remove(message);
+    loconet_tx_stats.abandoned++;
+    loconet_tx_abandoned = message;
+    return;
+  }
+#endif
+
+  // Reset transmit and receive index
+  message->tx_index = 0;
+  message->rx_index = 0;
+  // Place message back at front of queue, a newer report for the same
+  // address replaces its state again
+  loconet_tx_bucket_push_front(message);
+  loconet_tx_coalesce_add(message);
+}
+
+//-----------------------------------------------------------------------------
+uint8_t loconet_tx_priority_delay(uint8_t priority)
+{
+  uint8_t delay = priority + loconet_tx_backoff_delay;
+  return delay > LOCONET_TX_BACKOFF_MAX ? LOCONET_TX_BACKOFF_MAX : delay;
 }
 
 //-----------------------------------------------------------------------------
@@ -84,8 +535,37 @@ uint8_t loconet_tx_finished(void)
 //-----------------------------------------------------------------------------
 void loconet_tx_process(void)
 {
+  // Report and free an abandoned message
+  if (loconet_tx_abandoned) {
+    LOCONET_MESSAGE_Type *message = loconet_tx_abandoned;
+    loconet_tx_abandoned = 0;
+    loconet_tx_abandoned_event(message->data, message->data_length);
+    LOCONET_TX_CRITICAL_ENTER();
+    loconet_tx_pool_free(message);
+    LOCONET_TX_CRITICAL_EXIT();
+  }
+
+#ifdef LOCONET_TX_ECHO
+  // Handle a sent message as if it was received, before the next message
+  // can be sent
+  if (loconet_tx_echo) {
+    LOCONET_MESSAGE_Type *message = loconet_tx_echo;
+    loconet_rx_dispatch_local(message->data, message->data_length);
+    loconet_tx_echo = 0;
+    LOCONET_TX_CRITICAL_ENTER();
+    loconet_tx_pool_free(message);
+    LOCONET_TX_CRITICAL_EXIT();
+  }
+#endif
+
+  // Tell producers which were rejected that there might be room again
+  if (loconet_tx_room == LOCONET_TX_ROOM) {
+    loconet_tx_room = LOCONET_TX_ROOM_IDLE;
+    loconet_tx_room_event();
+  }
+
   // Can we start transmission?
-  if (!loconet_tx_queue) {
+  if (!loconet_tx_ready) {
     // No message is in the queue
     return;
   } else if (loconet_status.reg & (LOCONET_STATUS_BUSY | LOCONET_STATUS_TRANSMIT | LOCONET_STATUS_COLLISION_DETECT)) {
@@ -101,9 +581,10 @@ void loconet_tx_process(void)
   loconet_status.reg |= LOCONET_STATUS_TRANSMIT;
 
   // Set which bytes need to be send
-  loconet_tx_current = loconet_tx_queue;
-  loconet_tx_queue = loconet_tx_current->next;
-  loconet_tx_current->next = 0;
+  LOCONET_TX_CRITICAL_ENTER();
+  loconet_tx_current = loconet_tx_bucket_pop(loconet_tx_next_priority());
+  LOCONET_TX_CRITICAL_EXIT();
+  trace_event(TRACE_TX_START, loconet_tx_current->data[0], loconet_tx_current->data_length, loconet_tx_current->retries);
 
   // Start sending
   loconet_enable_transmit();
@@ -114,71 +595,140 @@ void loconet_tx_process(void)
 //-----------------------------------------------------------------------------
 static void loconet_tx_enqueue(LOCONET_MESSAGE_Type *message)
 {
-  // If queue is empty, push it
-  if (!loconet_tx_queue) {
-    loconet_tx_queue = message;
-    return;
-  }
+  message->queued = timer_ms();
+  LOCONET_TX_CRITICAL_ENTER();
+  loconet_tx_bucket_push(message);
+  loconet_tx_coalesce_add(message);
+  LOCONET_TX_CRITICAL_EXIT();
+}
 
-  // Pointers to previous and current node
-  LOCONET_MESSAGE_Type *prev = loconet_tx_queue;
-  LOCONET_MESSAGE_Type *curr = loconet_tx_queue->next;
+//-----------------------------------------------------------------------------
+// Take a message for the queue of a priority. Returns 0 if the queue is
+// full or the pool is exhausted, unless the oldest waiting message of the
+// same priority may be dropped.
+static inline LOCONET_MESSAGE_Type *loconet_tx_take(LOCONET_TX_POOL_Type *pool, uint8_t priority)
+{
+  LOCONET_TX_BUCKET_Type *bucket = &loconet_tx_buckets[priority];
+  uint8_t full = bucket->count >= loconet_tx_capacity[priority];
 
-  // Loop through message which are more important (lower priority)
-  for (; curr && curr->priority < message->priority + 1; prev = curr, curr = curr->next);
+  if (!full && loconet_tx_pool_available(pool)) {
+    return loconet_tx_pool_alloc(pool);
+  }
 
-  // Loop through messages which have the same priority.
-  // All priority should be lowered by 1, and place the message at the end.
-  for (; curr && curr->priority < message->priority + 2; curr->priority--, prev = curr, curr = curr->next);
-  prev->next = message;
-  message->next = curr;
+#if LOCONET_TX_FULL == LOCONET_TX_FULL_DROP_OLDEST
+  // Drop the oldest message, if that makes room for the new message
+  if (bucket->head) {
+    uint8_t same_pool = loconet_tx_pool(bucket->head->data_length) == pool;
+    if (same_pool || loconet_tx_pool_available(pool)) {
+      LOCONET_MESSAGE_Type *oldest = loconet_tx_bucket_pop(priority);
+      loconet_tx_stats.dropped++;
+      if (same_pool) {
+        return oldest;
+      }
+      loconet_tx_pool_free(oldest);
+      return loconet_tx_pool_alloc(pool);
+    }
+  }
+#endif
 
-  // All next messages should have their priorities decreased.
-  // This prevents starvation of messages at the end of the queue
-  for (; curr; curr->priority--, curr = curr->next);
+  if (!loconet_tx_pool_available(pool)) {
+    pool->stats->exhausted++;
+  }
+  return 0;
 }
 
 //-----------------------------------------------------------------------------
 // Build an empty message with the correct length
-static LOCONET_MESSAGE_Type *loconet_build_message(uint8_t length)
-{
-  // Allocate space for linked list node
-  LOCONET_MESSAGE_Type *message = malloc(sizeof(LOCONET_MESSAGE_Type));
-  memset(message, 0, sizeof(LOCONET_MESSAGE_Type));
-  // Allocate space for message bytes
-  message->data = malloc(sizeof(uint8_t) * length);
-  message->data_length = length;
-  // Return the new message
-  return message;
+static enum status_code loconet_build_message(uint8_t length, uint8_t priority, LOCONET_MESSAGE_Type **message)
+{
+  LOCONET_TX_POOL_Type *pool = loconet_tx_pool(length);
+  if (length > pool->data_size) {
+    return STATUS_ERR_INVALID_ARG;
+  }
+  if (priority >= LOCONET_TX_PRIORITIES) {
+    priority = LOCONET_TX_PRIORITIES - 1;
+  }
+
+  LOCONET_TX_CRITICAL_ENTER();
+  *message = loconet_tx_take(pool, priority);
+  if (!*message) {
+    loconet_tx_stats.rejected++;
+    loconet_tx_room = LOCONET_TX_ROOM_WANTED;
+  }
+  LOCONET_TX_CRITICAL_EXIT();
+
+  if (!*message) {
+    return loconet_tx_pool_available(pool) ? STATUS_ERR_OVERFLOW : STATUS_ERR_NO_MEMORY;
+  }
+
+  (*message)->priority = priority;
+  (*message)->next = 0;
+  (*message)->data_length = length;
+  (*message)->tx_index = 0;
+  (*message)->rx_index = 0;
+  (*message)->retries = 0;
+  return STATUS_OK;
 }
 
 //-----------------------------------------------------------------------------
 uint16_t loconet_tx_queue_size(void)
 {
-  uint16_t length = 0;
-  LOCONET_MESSAGE_Type *curr = loconet_tx_queue;
-  for (; curr; length++, curr = curr->next);
-  return length;
+  return loconet_tx_count;
+}
+
+//-----------------------------------------------------------------------------
+void loconet_tx_set_capacity(uint8_t priority, uint8_t capacity)
+{
+  if (priority < LOCONET_TX_PRIORITIES) {
+    loconet_tx_capacity[priority] = capacity;
+  }
+}
+
+//-----------------------------------------------------------------------------
+uint8_t loconet_tx_has_room(uint8_t priority, uint8_t length)
+{
+  if (priority >= LOCONET_TX_PRIORITIES) {
+    priority = LOCONET_TX_PRIORITIES - 1;
+  }
+  LOCONET_TX_POOL_Type *pool = loconet_tx_pool(length);
+  return length <= pool->data_size
+    && loconet_tx_buckets[priority].count < loconet_tx_capacity[priority]
+    && loconet_tx_pool_available(pool);
 }
 
 //-----------------------------------------------------------------------------
-void loconet_tx_queue_2(uint8_t opcode, uint8_t priority)
+enum status_code loconet_tx_queue_2(uint8_t opcode, uint8_t priority)
 {
-  LOCONET_MESSAGE_Type *message = loconet_build_message(2);
-  // Set priority
-  message->priority = priority;
+  LOCONET_MESSAGE_Type *message;
+  enum status_code status = loconet_build_message(2, priority, &message);
+  if (status != STATUS_OK) {
+    return status;
+  }
   // Fill message
   message->data[0] = opcode;
   message->data[1] = loconet_calc_checksum(message->data, 1);
   // Enqueue message
   loconet_tx_enqueue(message);
+  return STATUS_OK;
 }
 
-void loconet_tx_queue_4(uint8_t opcode, uint8_t priority, uint8_t  a, uint8_t b)
+enum status_code loconet_tx_queue_4(uint8_t opcode, uint8_t priority, uint8_t  a, uint8_t b)
 {
-  LOCONET_MESSAGE_Type *message = loconet_build_message(4);
-  // Set priority
-  message->priority = priority;
+#ifdef LOCONET_TX_COALESCE
+  // Only the latest state of a report has to be sent. The collision
+  // interrupt adds reports to the hash table too.
+  LOCONET_TX_CRITICAL_ENTER();
+  uint8_t replaced = loconet_tx_coalesce_replace(opcode, a, b);
+  LOCONET_TX_CRITICAL_EXIT();
+  if (replaced) {
+    return STATUS_OK;
+  }
+#endif
+  LOCONET_MESSAGE_Type *message;
+  enum status_code status = loconet_build_message(4, priority, &message);
+  if (status != STATUS_OK) {
+    return status;
+  }
   // Fill message
   message->data[0] = opcode;
   message->data[1] = a;
@@ -186,13 +736,16 @@ void loconet_tx_queue_4(uint8_t opcode, uint8_t priority, uint8_t  a, uint8_t b)
   message->data[3] = loconet_calc_checksum(message->data, 3);
   // Enqueue message
   loconet_tx_enqueue(message);
+  return STATUS_OK;
 }
 
-void loconet_tx_queue_6(uint8_t opcode, uint8_t priority, uint8_t  a, uint8_t b, uint8_t c, uint8_t d)
+enum status_code loconet_tx_queue_6(uint8_t opcode, uint8_t priority, uint8_t  a, uint8_t b, uint8_t c, uint8_t d)
 {
-  LOCONET_MESSAGE_Type *message = loconet_build_message(6);
-  // Set priority
-  message->priority = priority;
+  LOCONET_MESSAGE_Type *message;
+  enum status_code status = loconet_build_message(6, priority, &message);
+  if (status != STATUS_OK) {
+    return status;
+  }
   // Fill message
   message->data[0] = opcode;
   message->data[1] = a;
@@ -202,17 +755,56 @@ void loconet_tx_queue_6(uint8_t opcode, uint8_t priority, uint8_t  a, uint8_t b,
   message->data[5] = loconet_calc_checksum(message->data, 5);
   // Enqueue message
   loconet_tx_enqueue(message);
+  return STATUS_OK;
 }
 
-void loconet_tx_queue_n(uint8_t opcode, uint8_t priority, uint8_t *data, uint8_t length)
+enum status_code loconet_tx_queue_n(uint8_t opcode, uint8_t priority, uint8_t *data, uint8_t length)
 {
-  LOCONET_MESSAGE_Type *message = loconet_build_message(length + 2);
-  // Set priority
-  message->priority = priority;
+  uint8_t *payload;
+  enum status_code status = loconet_tx_reserve(opcode, priority, length, &payload);
+  if (status != STATUS_OK) {
+    return status;
+  }
   // Fill message
+  for(uint8_t idx = 0; idx < length; payload[idx] = data[idx], idx++);
+  // Enqueue message
+  loconet_tx_commit();
+  return STATUS_OK;
+}
+
+//-----------------------------------------------------------------------------
+enum status_code loconet_tx_reserve(uint8_t opcode, uint8_t priority, uint8_t length, uint8_t **data)
+{
+  // Only one message can be reserved at a time
+  if (loconet_tx_reserved) {
+    return STATUS_BUSY;
+  }
+  // Opcode and checksum have to fit in the length of a message
+  if (length > 0x7F - 2) {
+    return STATUS_ERR_INVALID_ARG;
+  }
+  LOCONET_MESSAGE_Type *message;
+  enum status_code status = loconet_build_message(length + 2, priority, &message);
+  if (status != STATUS_OK) {
+    return status;
+  }
   message->data[0] = opcode;
-  for(uint8_t idx = 0; idx < length; message->data[idx+1] = data[idx], idx++);
-  message->data[length+1] = loconet_calc_checksum(message->data, length + 1);
+  loconet_tx_reserved = message;
+  *data = &message->data[1];
+  return STATUS_OK;
+}
+
+//-----------------------------------------------------------------------------
+void loconet_tx_commit(void)
+{
+  LOCONET_MESSAGE_Type *message = loconet_tx_reserved;
+  if (!message) {
+    return;
+  }
+  loconet_tx_reserved = 0;
+  // Finalise the message
+  uint8_t length = message->data_length - 1;
+  message->data[length] = loconet_calc_checksum(message->data, length);
   // Enqueue message
   loconet_tx_enqueue(message);
 }
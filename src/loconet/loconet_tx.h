@@ -16,6 +16,42 @@
 
 #include <stdint.h>
 #include "loconet.h"
+#include "utils/status_codes.h"
+
+//-----------------------------------------------------------------------------
+// What to do with a new message when its priority is at capacity or its
+// pool is exhausted:
+// - REJECT:      do not queue the message (default)
+// - DROP_OLDEST: drop the oldest waiting message of the same priority
+#define LOCONET_TX_FULL_REJECT      0
+#define LOCONET_TX_FULL_DROP_OLDEST 1
+
+#ifndef LOCONET_TX_FULL
+#define LOCONET_TX_FULL LOCONET_TX_FULL_REJECT
+#endif
+
+//-----------------------------------------------------------------------------
+// Usage of a message pool, updated from the main loop and interrupts
+typedef struct {
+  uint8_t used;           // Messages in use
+  uint8_t high_watermark; // Most messages in use at once
+  uint16_t exhausted;     // Messages not sent because the pool was empty
+} LOCONET_TX_POOL_STATS_Type;
+
+typedef struct {
+  LOCONET_TX_POOL_STATS_Type small; // Messages up to 6 bytes
+  LOCONET_TX_POOL_STATS_Type large; // Variable length messages
+  uint16_t rejected;                // Messages which were not queued
+  uint16_t dropped;                 // Waiting messages dropped for a new one
+  uint16_t coalesced;               // Reports merged into a waiting report
+  uint16_t retries;                 // Messages sent again after a collision
+  uint16_t abandoned;               // Messages given up after LOCONET_TX_RETRIES
+  uint16_t transmitted;             // Messages sent
+  uint16_t wait_max;                // Longest time from queued to sent (ms, saturates)
+  uint32_t wait_total;              // Total time from queued to sent (ms)
+} LOCONET_TX_STATS_Type;
+
+extern volatile LOCONET_TX_STATS_Type loconet_tx_stats;
 
 //-----------------------------------------------------------------------------
 // Stop sending
@@ -25,6 +61,16 @@ extern void loconet_tx_stop(void);
 // Reset indexes of the message and place it at the front of the queue
 extern void loconet_tx_reset_current_message_to_queue(void);
 
+//-----------------------------------------------------------------------------
+// Priority delay (in bit times) before sending, the priority is raised by a
+// random backoff after a collision
+extern uint8_t loconet_tx_priority_delay(uint8_t priority);
+
+//-----------------------------------------------------------------------------
+// Called from loconet_tx_process when a message is abandoned after
+// LOCONET_TX_RETRIES collisions
+extern void loconet_tx_abandoned_event(uint8_t *data, uint8_t length);
+
 //-----------------------------------------------------------------------------
 // Give the next byte we expect on the RX line
 extern uint8_t loconet_tx_next_rx_byte(void);
@@ -46,10 +92,37 @@ extern void loconet_tx_process(void);
 extern uint16_t loconet_tx_queue_size(void);
 
 //-----------------------------------------------------------------------------
-// Enqueue a message
-extern void loconet_tx_queue_2(uint8_t opcode, uint8_t priority);
-extern void loconet_tx_queue_4(uint8_t opcode, uint8_t priority, uint8_t  a, uint8_t b);
-extern void loconet_tx_queue_6(uint8_t opcode, uint8_t priority, uint8_t  a, uint8_t b, uint8_t c, uint8_t d);
-extern void loconet_tx_queue_n(uint8_t opcode, uint8_t priority, uint8_t *d, uint8_t l);
+// Maximum number of waiting messages of a priority, default
+// LOCONET_TX_CAPACITY (no maximum).
+extern void loconet_tx_set_capacity(uint8_t priority, uint8_t capacity);
+
+//-----------------------------------------------------------------------------
+// Can a message of length bytes be queued without dropping another message?
+extern uint8_t loconet_tx_has_room(uint8_t priority, uint8_t length);
+
+//-----------------------------------------------------------------------------
+// Called from loconet_tx_process after a message was rejected, when a
+// message has left the queue since.
+extern void loconet_tx_room_event(void);
+
+//-----------------------------------------------------------------------------
+// Enqueue a message, returns:
+// - STATUS_OK: the message is queued
+// - STATUS_ERR_OVERFLOW: the priority is at capacity
+// - STATUS_ERR_NO_MEMORY: the pool of the message is exhausted
+// - STATUS_ERR_INVALID_ARG: the message is too long
+extern enum status_code loconet_tx_queue_2(uint8_t opcode, uint8_t priority);
+extern enum status_code loconet_tx_queue_4(uint8_t opcode, uint8_t priority, uint8_t  a, uint8_t b);
+extern enum status_code loconet_tx_queue_6(uint8_t opcode, uint8_t priority, uint8_t  a, uint8_t b, uint8_t c, uint8_t d);
+extern enum status_code loconet_tx_queue_n(uint8_t opcode, uint8_t priority, uint8_t *d, uint8_t l);
+
+//-----------------------------------------------------------------------------
+// Build a message in place: reserve a message with length bytes between
+// the opcode and the checksum, write them through data and commit the
+// message to calculate its checksum and queue it. Only one message can be
+// reserved at a time, loconet_tx_reserve returns STATUS_BUSY while a
+// message is reserved and otherwise the same as loconet_tx_queue_X.
+extern enum status_code loconet_tx_reserve(uint8_t opcode, uint8_t priority, uint8_t length, uint8_t **data);
+extern void loconet_tx_commit(void);
 
 #endif // _LOCONET_LOCONET_TX_H_
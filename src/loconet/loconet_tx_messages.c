@@ -12,38 +12,38 @@
 #include "loconet_tx_messages.h"
 
 // 2 byte messages
-void loconet_tx_busy(void)
+enum status_code loconet_tx_busy(void)
 {
-  loconet_tx_queue_2(0x81, 1);
+  return loconet_tx_queue_2(0x81, 1);
 }
 
-void loconet_tx_gpoff(void)
+enum status_code loconet_tx_gpoff(void)
 {
-  loconet_tx_queue_2(0x82, 5);
+  return loconet_tx_queue_2(0x82, 5);
 }
 
-void loconet_tx_gpon(void)
+enum status_code loconet_tx_gpon(void)
 {
-  loconet_tx_queue_2(0x83, 5);
+  return loconet_tx_queue_2(0x83, 5);
 }
 
-void loconet_tx_idle(void)
+enum status_code loconet_tx_idle(void)
 {
-  loconet_tx_queue_2(0x85, 1);
+  return loconet_tx_queue_2(0x85, 1);
 }
 
 // 4 byte messages
-void loconet_tx_sq_req(uint16_t address, bool dir, bool state)
+enum status_code loconet_tx_sq_req(uint16_t address, bool dir, bool state)
 {
   uint8_t byte1 = address & 0x7F;
   uint8_t byte2 = ((address >> 7) & 0x0F)
     | (state << 5)
     | (dir << 6);
 
-  loconet_tx_queue_4(0xB0, 5, byte1, byte2);
+  return loconet_tx_queue_4(0xB0, 5, byte1, byte2);
 }
 
-void loconet_tx_sw_rep(uint16_t address, bool state)
+enum status_code loconet_tx_sw_rep(uint16_t address, bool state)
 {
   uint8_t byte1 = address & 0x7F;
   uint8_t byte2 = ((address >> 7) & 0x0F)
@@ -51,11 +51,11 @@ void loconet_tx_sw_rep(uint16_t address, bool state)
     | (0 << 6)
     | 0x40;
 
-  loconet_tx_queue_4(0xB1, 5, byte1, byte2);
+  return loconet_tx_queue_4(0xB1, 5, byte1, byte2);
 }
 
 // For 4K sensor address space we need to 'code' the address
-void loconet_tx_input_rep(uint16_t address, bool state)
+enum status_code loconet_tx_input_rep(uint16_t address, bool state)
 {
   // I is used as odd/even bit
   uint8_t odd = address & 0x01;
@@ -73,32 +73,37 @@ void loconet_tx_input_rep(uint16_t address, bool state)
     | 0x40;
 
   // Queue a 0xB2
-  loconet_tx_queue_4(0xB2, 5, byte1, byte2);
+  return loconet_tx_queue_4(0xB2, 5, byte1, byte2);
 }
 
-void loconet_tx_long_ack(uint8_t lopc, uint8_t ack1)
+enum status_code loconet_tx_long_ack(uint8_t lopc, uint8_t ack1)
 {
-  loconet_tx_queue_4(0xB4, 1, lopc & 0x7F, ack1 & 0x7F);
+  return loconet_tx_queue_4(0xB4, 1, lopc & 0x7F, ack1 & 0x7F);
 }
 
 // ----------------------------------------------------------------------------
-void loconet_tx_fast_clock(uint8_t clk_rate, uint8_t frac_minsl, uint8_t frac_minsh, uint8_t minutes, uint8_t hours, uint8_t days, uint8_t id1, uint8_t id2)
+enum status_code loconet_tx_fast_clock(uint8_t clk_rate, uint8_t frac_minsl, uint8_t frac_minsh, uint8_t minutes, uint8_t hours, uint8_t days, uint8_t id1, uint8_t id2)
 {
-  uint8_t length = 11;
-  uint8_t data[length];
-
-  data[0] = 0x7B; // address of the clock
-  data[1] = clk_rate;
-  data[2] = frac_minsl;
-  data[3] = frac_minsh;
-
-  data[4] = minutes + (128-60);
-  data[5] = 0x06; // trk
-  data[6] = hours + (128-24);
-  data[7] = days;
-  data[8] = 0x01; // it is a valid clock setting!
-  data[9] = id1;
-  data[10] = id2;
-
-  loconet_tx_queue_n(0xEF, 10, data, length);
+  uint8_t *data;
+  enum status_code status = loconet_tx_reserve(0xEF, 10, 12, &data);
+  if (status != STATUS_OK) {
+    return status;
+  }
+
+  data[0] = 0x0E; // length of the message
+  data[1] = 0x7B; // address of the clock
+  data[2] = clk_rate;
+  data[3] = frac_minsl;
+  data[4] = frac_minsh;
+
+  data[5] = minutes + (128-60);
+  data[6] = 0x06; // trk
+  data[7] = hours + (128-24);
+  data[8] = days;
+  data[9] = 0x01; // it is a valid clock setting!
+  data[10] = id1;
+  data[11] = id2;
+
+  loconet_tx_commit();
+  return STATUS_OK;
 }
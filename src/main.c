@@ -36,8 +36,12 @@
 #include "components/fast_clock.h"
 #include "loconet/loconet.h"
 #include "loconet/loconet_cv.h"
+#include "loconet/loconet_fault.h"
+#include "loconet/loconet_transaction.h"
 #include "utils/eeprom.h"
 #include "utils/logger.h"
+#include "utils/profile.h"
+#include "utils/timer.h"
 
 //-----------------------------------------------------------------------------
 LOCONET_BUILD(
@@ -59,25 +63,12 @@ LOGGER_BUILD(
 );
 
 
-//-----------------------------------------------------------------------------
-void irq_handler_hard_fault(void);
-void irq_handler_hard_fault()
-{
-  logger_newline();
-  logger_string("Tx queue size: ");
-  logger_number(loconet_tx_queue_size());
-  logger_newline();
-  logger_string("HARD FAULT");
-  logger_error();
-  while(1);
-}
-
 //-----------------------------------------------------------------------------
 void irq_handler_eic(void);
 void irq_handler_eic(void) {
-  if (loconet_handle_eic()) {
-    return;
-  }
+  PROFILE_ENTER(PROFILE_EIC);
+  loconet_handle_eic();
+  PROFILE_EXIT(PROFILE_EIC);
 }
 
 //-----------------------------------------------------------------------------
@@ -124,8 +115,10 @@ static inline void initialize(void)
 {
   // System
   sys_init();
+  timer_init();
   eeprom_init();
   logger_init(LOGGER_BAUDRATE);
+  loconet_fault_init();
 
   // Core
   loconet_cv_init();
@@ -143,11 +136,19 @@ int main(void)
 
   while (1) {
     // If a message is received and handled, keep processing new messages
+    PROFILE_ENTER(PROFILE_RX_PROCESS);
     while(loconet_rx_process());
+    PROFILE_EXIT(PROFILE_RX_PROCESS);
     // Send a message if there is one available
+    PROFILE_ENTER(PROFILE_TX_PROCESS);
     loconet_tx_process();
+    PROFILE_EXIT(PROFILE_TX_PROCESS);
+    // Complete transactions which timed out
+    loconet_transaction_process();
     // Process time updates if there are any
+    PROFILE_ENTER(PROFILE_FAST_CLOCK);
     fast_clock_process();
+    PROFILE_EXIT(PROFILE_FAST_CLOCK);
   }
   return 0;
 }
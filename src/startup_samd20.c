@@ -27,6 +27,7 @@
  */
 
 #include "samd20.h"
+#include "utils/memory.h"
 
 //-----------------------------------------------------------------------------
 void irq_handler_dummy(void);
@@ -155,6 +156,11 @@ void irq_handler_reset(void)
   while (dst < &_ezero)
     *dst++ = 0;
 
+  // Paint the unused stack, keep the words in use by this function
+  dst = &_sstack;
+  while (dst < (unsigned int *)(uintptr_t)__get_MSP() - 8)
+    *dst++ = MEMORY_PAINT;
+
   // Set the vector table base address
   src = (unsigned int *) &_sfixed;
   SCB->VTOR = ((unsigned int) src & SCB_VTOR_TBLOFF_Msk);
@@ -12,12 +12,160 @@
 // Do we want logging?
 #ifdef UTILS_LOGGER
 
+#include <stdbool.h>
+#include "ringbuffer.h"
+
 const char logger_hello[]   = "USART Logger started";
 const char logger_newline[] = "\r\n";
 const char logger_dot[]     = ".";
 const char logger_ok[]      = " [ok]\r\n";
 const char logger_error[]   = " [error]\r\n";
 
+RINGBUFFER_BUILD(logger_ringbuffer, LOGGER_BUFFER_SIZE);
+
+_Static_assert(LOGGER_TOKEN_SIZE <= LOGGER_BUFFER_SIZE,
+  "LOGGER_BUFFER_SIZE is too small for a tokenised message");
+
+Sercom *logger_sercom;
+volatile uint8_t logger_policy = LOGGER_POLICY;
+volatile uint32_t logger_dropped = 0;
+
+// End of the last tokenised message or byte written while waiting (binary
+// dumps). Dropping the oldest bytes before it could cut these in half.
+static uint32_t logger_protected = 0;
+
+//-----------------------------------------------------------------------------
+// Can the interrupt empty the ringbuffer while we wait? Not when interrupts
+// are disabled or when we are an interrupt (e.g. the hard fault handler).
+static inline bool logger_irq_can_send(void)
+{
+  return !__get_PRIMASK() && !(SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk);
+}
+
+//-----------------------------------------------------------------------------
+// Send the oldest byte without the interrupt, interrupts have to be disabled
+static void logger_send_oldest(void)
+{
+  while (!(logger_sercom->USART.INTFLAG.reg & SERCOM_USART_INTFLAG_DRE));
+  logger_sercom->USART.DATA.reg = *ringbuffer_at(&logger_ringbuffer, logger_ringbuffer.reader);
+  ringbuffer_release(&logger_ringbuffer, 1);
+}
+
+//-----------------------------------------------------------------------------
+// Data register empty, send the next byte or stop when all are sent
+void logger_irq_sercom(void)
+{
+  uint8_t byte;
+  if (ringbuffer_pop(&logger_ringbuffer, &byte)) {
+    logger_sercom->USART.DATA.reg = byte;
+  } else {
+    logger_sercom->USART.INTENCLR.reg = SERCOM_USART_INTENCLR_DRE;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Write the bytes at once, so they are either all sent or all dropped
+static void logger_write(const uint8_t *data, uint8_t length)
+{
+  // Let the interrupt make room, if it can
+  if (logger_policy == LOGGER_WAIT && logger_irq_can_send()) {
+    while (ringbuffer_free(&logger_ringbuffer) < length);
+  }
+
+  // The logger can be used from interrupts too, don't let them interfere
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  uint8_t policy = logger_policy;
+  uint32_t free = ringbuffer_free(&logger_ringbuffer);
+  if (free < length) {
+    // Only drop the oldest bytes when they are all plain text
+    if (policy == LOGGER_DROP_OLDEST
+        && (int32_t)(logger_protected - logger_ringbuffer.reader) > 0) {
+      policy = LOGGER_DROP_NEWEST;
+    }
+    switch (policy) {
+      case LOGGER_WAIT:
+        for (; free < length; free++) {
+          logger_send_oldest();
+        }
+        break;
+      case LOGGER_DROP_OLDEST:
+        ringbuffer_release(&logger_ringbuffer, length - free);
+        logger_dropped += length - free;
+        break;
+      default:
+        logger_dropped += length;
+        __set_PRIMASK(primask);
+        return;
+    }
+  }
+
+  for (uint8_t index = 0; index < length; index++) {
+    *ringbuffer_at(&logger_ringbuffer, logger_ringbuffer.writer + index) = data[index];
+  }
+  ringbuffer_commit(&logger_ringbuffer, length);
+  if (length > 1 || policy == LOGGER_WAIT) {
+    logger_protected = logger_ringbuffer.writer;
+  }
+  logger_sercom->USART.INTENSET.reg = SERCOM_USART_INTENSET_DRE;
+
+  __set_PRIMASK(primask);
+}
+
+//-----------------------------------------------------------------------------
+void logger_usart_queue(char c)
+{
+  logger_write((uint8_t *)&c, 1);
+}
+
+//-----------------------------------------------------------------------------
+// Tokenised message: marker, id of the format, number of arguments and the
+// arguments, multi-byte values are little endian.
+void logger_token(const char *format, const uint32_t *args, uint8_t count)
+{
+  uint8_t frame[LOGGER_TOKEN_SIZE];
+  uint16_t id = (uint16_t)(uintptr_t)format;
+  uint8_t length = 0;
+
+  frame[length++] = LOGGER_TOKEN;
+  frame[length++] = id & 0xFF;
+  frame[length++] = id >> 8;
+  frame[length++] = count;
+  for (uint8_t arg = 0; arg < count; arg++) {
+    frame[length++] = args[arg] & 0xFF;
+    frame[length++] = (args[arg] >> 8) & 0xFF;
+    frame[length++] = (args[arg] >> 16) & 0xFF;
+    frame[length++] = args[arg] >> 24;
+  }
+
+  logger_write(frame, length);
+}
+
+//-----------------------------------------------------------------------------
+uint8_t logger_set_policy(uint8_t policy)
+{
+  uint8_t previous = logger_policy;
+  logger_policy = policy;
+  return previous;
+}
+
+//-----------------------------------------------------------------------------
+void logger_flush(void)
+{
+  if (logger_irq_can_send()) {
+    while (!ringbuffer_is_empty(&logger_ringbuffer));
+    return;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  while (!ringbuffer_is_empty(&logger_ringbuffer)) {
+    logger_send_oldest();
+  }
+  __set_PRIMASK(primask);
+}
+
 void logger_string(char *s)
 {
   while (*s) {
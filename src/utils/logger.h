@@ -22,6 +22,28 @@
  *  Before you can use the logger functions, initialize the logger
  *  using `logger_init(baudrate);`.
  *
+ *  Logged bytes are written to a ringbuffer of LOGGER_BUFFER_SIZE bytes
+ *  (default 256, a power of two) and sent from the data register empty
+ *  interrupt, so logging returns immediately. When the ringbuffer is full
+ *  `logger_policy` decides what happens (default LOGGER_POLICY):
+ *  - LOGGER_DROP_NEWEST: the new byte is dropped
+ *  - LOGGER_DROP_OLDEST: the oldest bytes in the ringbuffer are dropped,
+ *                        unless a tokenised message or a binary dump is
+ *                        waiting, then the new bytes are dropped
+ *  - LOGGER_WAIT:        wait until the byte fits, this blocks like a
+ *                        logger without ringbuffer
+ *  Dropped bytes are counted in `logger_dropped`.
+ *
+ *  Tokenised messages are not formatted on the chip:
+ *
+ *      logger_log("Switch %u set to %d", address, state);
+ *
+ *  The format is placed in the `.logger_formats` section, which is kept in
+ *  the elf file but not in flash. Only the address of the format in that
+ *  section and the arguments (at most LOGGER_TOKEN_ARGS, as 32 bits words)
+ *  are sent, tools/log_decode.py formats them using the elf file. A
+ *  tokenised message is either sent completely or dropped completely.
+ *
  * @author Ferdi van der Werf <ferdi@slashdev.nl>
  */
 
@@ -33,12 +55,36 @@
 #define LOGGER_BAUDRATE 115200
 #endif
 
+// What to do with a byte when the ringbuffer is full
+#define LOGGER_DROP_NEWEST 0
+#define LOGGER_DROP_OLDEST 1
+#define LOGGER_WAIT        2
+
+#ifndef LOGGER_POLICY
+#define LOGGER_POLICY LOGGER_DROP_NEWEST
+#endif
+
 // Do we want logging?
 #ifdef UTILS_LOGGER
 
 #include <stdint.h>
+#include "samd20.h"
 #include "delay.h"
 
+#ifndef LOGGER_BUFFER_SIZE
+#define LOGGER_BUFFER_SIZE 256
+#endif
+
+// Maximum number of arguments of a tokenised message
+#ifndef LOGGER_TOKEN_ARGS
+#define LOGGER_TOKEN_ARGS 4
+#endif
+
+// First byte of a tokenised message, never part of text
+#define LOGGER_TOKEN 0xFF
+// Marker, id, number of arguments and the arguments
+#define LOGGER_TOKEN_SIZE (4 + 4 * LOGGER_TOKEN_ARGS)
+
 #define LOGGER_BUILD(                                                         \
     pmux, sercom, tx_pad, rx_pad,                                             \
     tx_port, tx_pin, rx_port, rx_pin                                          \
@@ -46,10 +92,11 @@
   HAL_GPIO_PIN(LOGGER_TX, tx_port, tx_pin);                                   \
   HAL_GPIO_PIN(LOGGER_RX, rx_port, rx_pin);                                   \
                                                                               \
-  void logger_usart_queue(char c)                                             \
+  /* Send bytes from the ringbuffer */                                        \
+  void irq_handler_sercom##sercom(void);                                      \
+  void irq_handler_sercom##sercom(void)                                       \
   {                                                                           \
-    while (!(SERCOM##sercom->USART.INTFLAG.reg & SERCOM_USART_INTFLAG_DRE));  \
-    SERCOM##sercom->USART.DATA.reg = c;                                       \
+    logger_irq_sercom();                                                      \
   }                                                                           \
                                                                               \
   static inline void logger_init(uint32_t baud)                               \
@@ -82,6 +129,10 @@
     uint64_t br = (uint64_t)65536 * (F_CPU - 16 * baud) / F_CPU;              \
     SERCOM##sercom->USART.BAUD.reg = (uint16_t)br;                            \
                                                                               \
+    /* Send from the data register empty interrupt */                         \
+    logger_sercom = SERCOM##sercom;                                           \
+    NVIC_EnableIRQ(SERCOM##sercom##_IRQn);                                    \
+                                                                              \
     /* Enable the peripheral */                                               \
     SERCOM##sercom->USART.CTRLA.reg |= SERCOM_USART_CTRLA_ENABLE;             \
                                                                               \
@@ -101,7 +152,16 @@ extern const char logger_dot[];
 extern const char logger_ok[];
 extern const char logger_error[];
 
+extern Sercom *logger_sercom;
+extern volatile uint8_t logger_policy;
+extern volatile uint32_t logger_dropped;
+
+extern void logger_irq_sercom(void);
 extern void logger_usart_queue(char c);
+// Wait until all logged bytes are sent
+extern void logger_flush(void);
+// Change the policy, returns the previous policy
+extern uint8_t logger_set_policy(uint8_t policy);
 #define logger_char(x) logger_usart_queue(x)
 extern void logger_string(char *string);
 extern void logger_cstring(const char *string);
@@ -115,10 +175,30 @@ extern void logger_number_(uint32_t value, uint8_t base, uint8_t padding);
 #define logger_ok() logger_cstring(logger_ok)
 #define logger_error() logger_cstring(logger_error)
 
+extern void logger_token(const char *format, const uint32_t *args, uint8_t count);
+#define logger_log(format, ...) do {                                          \
+    static const char logger_format[]                                         \
+      __attribute__ ((section (".logger_formats"), used)) = format;           \
+    const uint32_t logger_args[] = { 0, ##__VA_ARGS__ };                      \
+    _Static_assert(sizeof(logger_args) / sizeof(uint32_t) - 1                 \
+      <= LOGGER_TOKEN_ARGS, "Too many arguments for logger_log");             \
+    logger_token(logger_format, &logger_args[1],                              \
+      sizeof(logger_args) / sizeof(uint32_t) - 1);                            \
+  } while (0)
+
 #else // UTILS_LOGGER
 
+#include <stdint.h>
+
+static inline uint8_t logger_set_policy(uint8_t policy)
+{
+  (void)policy;
+  return LOGGER_POLICY;
+}
+
 #define LOGGER_BUILD(...)
 #define logger_usart_queue(...) do {} while (0)
+#define logger_flush(...) do {} while (0)
 #define logger_init(...) do {} while (0)
 #define logger_char(...) do {} while (0)
 #define logger_string(...) do {} while (0)
@@ -131,6 +211,8 @@ extern void logger_number_(uint32_t value, uint8_t base, uint8_t padding);
 #define logger_dot(...) do {} while (0)
 #define logger_ok(...) do {} while (0)
 #define logger_error(...) do {} while (0)
+#define logger_token(...) do {} while (0)
+#define logger_log(...) do {} while (0)
 
 #endif // UTILS_LOGGER
 
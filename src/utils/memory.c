@@ -0,0 +1,80 @@
+/**
+ * @file memory.c
+ * @brief High-watermarks of the stack and the heap
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#include <errno.h>
+#include "memory.h"
+#include "logger.h"
+
+extern uint32_t _sstack;
+extern uint32_t _estack;
+extern uint8_t _sheap;
+extern uint8_t _eram;
+
+static uint8_t *memory_heap_end = &_sheap;
+static uint8_t *memory_heap_max = &_sheap;
+
+//-----------------------------------------------------------------------------
+uint16_t memory_stack_size(void)
+{
+  return (uint8_t *)&_estack - (uint8_t *)&_sstack;
+}
+
+//-----------------------------------------------------------------------------
+uint16_t memory_stack_used(void)
+{
+  // The stack grows down, find the lowest word which has been written
+  uint32_t *word = &_sstack;
+  while (word < &_estack && *word == MEMORY_PAINT) {
+    word++;
+  }
+  return (uint8_t *)&_estack - (uint8_t *)word;
+}
+
+//-----------------------------------------------------------------------------
+uint16_t memory_heap_size(void)
+{
+  return &_eram - &_sheap;
+}
+
+//-----------------------------------------------------------------------------
+uint16_t memory_heap_used(void)
+{
+  return memory_heap_max - &_sheap;
+}
+
+//-----------------------------------------------------------------------------
+void *_sbrk(ptrdiff_t increment)
+{
+  uint8_t *previous = memory_heap_end;
+  if (increment > &_eram - previous || increment < &_sheap - previous) {
+    errno = ENOMEM;
+    return (void *)-1;
+  }
+
+  memory_heap_end += increment;
+  if (memory_heap_end > memory_heap_max) {
+    memory_heap_max = memory_heap_end;
+  }
+  return previous;
+}
+
+//-----------------------------------------------------------------------------
+void memory_dump(void)
+{
+  logger_string("Stack ");
+  logger_number(memory_stack_used());
+  logger_char('/');
+  logger_number(memory_stack_size());
+  logger_string(" heap ");
+  logger_number(memory_heap_used());
+  logger_char('/');
+  logger_number(memory_heap_size());
+  logger_newline();
+}
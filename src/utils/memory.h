@@ -0,0 +1,43 @@
+/**
+ * @file memory.h
+ * @brief High-watermarks of the stack and the heap
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * At reset the stack region (_sstack up to the stack pointer) is painted
+ * with MEMORY_PAINT. The deepest stack use is found by searching the first
+ * word which is no longer painted. Searching takes time, so only do it
+ * when the value is requested.
+ *
+ * The heap starts after the stack and grows up to the end of RAM, memory
+ * is taken from it by `_sbrk` (e.g. by malloc), which keeps the highest
+ * address it handed out.
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#ifndef _UTILS_MEMORY_H_
+#define _UTILS_MEMORY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Pattern of unused stack
+#define MEMORY_PAINT 0xC5C5C5C5
+
+//-----------------------------------------------------------------------------
+// Size of the stack in bytes
+extern uint16_t memory_stack_size(void);
+// Most bytes of the stack ever used, equals the size if it overflowed
+extern uint16_t memory_stack_used(void);
+// Bytes of the heap available for _sbrk
+extern uint16_t memory_heap_size(void);
+// Most bytes of the heap ever taken
+extern uint16_t memory_heap_used(void);
+// Write the high-watermarks to the logger
+extern void memory_dump(void);
+
+extern void *_sbrk(ptrdiff_t increment);
+
+#endif // _UTILS_MEMORY_H_
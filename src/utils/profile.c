@@ -0,0 +1,103 @@
+/**
+ * @file profile.c
+ * @brief Measure the number of cycles spent in code
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#include "profile.h"
+
+// Do we want profiling?
+#ifdef UTILS_PROFILE
+
+#include "logger.h"
+
+volatile PROFILE_SITE_Type profile_sites[PROFILE_SITES] = {
+  [0 ... PROFILE_SITES - 1] = { 0, 0xFFFFFFFF, 0, 0, { 0 } }
+};
+
+static const char *const profile_names[PROFILE_SITES] = {
+  "sercom",
+  "eic",
+  "flank timer",
+  "rx process",
+  "tx process",
+  "fast clock",
+};
+
+//-----------------------------------------------------------------------------
+void profile_record(uint8_t site, uint32_t cycles)
+{
+  volatile PROFILE_SITE_Type *profile = &profile_sites[site];
+
+  profile->count++;
+  profile->total += cycles;
+  if (cycles < profile->min) {
+    profile->min = cycles;
+  }
+  if (cycles > profile->max) {
+    profile->max = cycles;
+  }
+
+  // Bucket of the highest bit set
+  uint8_t bucket = 0;
+  while (cycles > 1 && bucket < PROFILE_BUCKETS - 1) {
+    cycles >>= 1;
+    bucket++;
+  }
+  profile->histogram[bucket]++;
+}
+
+//-----------------------------------------------------------------------------
+void profile_reset(void)
+{
+  for (uint8_t site = 0; site < PROFILE_SITES; site++) {
+    __disable_irq();
+    profile_sites[site].count = 0;
+    profile_sites[site].min = 0xFFFFFFFF;
+    profile_sites[site].max = 0;
+    profile_sites[site].total = 0;
+    for (uint8_t bucket = 0; bucket < PROFILE_BUCKETS; bucket++) {
+      profile_sites[site].histogram[bucket] = 0;
+    }
+    __enable_irq();
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Per site: name count min/mean/max and the histogram
+void profile_dump(void)
+{
+  // Wait instead of dropping when the logger is full
+  uint8_t policy = logger_set_policy(LOGGER_WAIT);
+
+  for (uint8_t site = 0; site < PROFILE_SITES; site++) {
+    volatile PROFILE_SITE_Type *profile = &profile_sites[site];
+    uint32_t count = profile->count;
+
+    logger_cstring(profile_names[site]);
+    logger_string(": ");
+    logger_number(count);
+    if (count) {
+      logger_string(" cycles ");
+      logger_number(profile->min);
+      logger_char('/');
+      logger_number((uint32_t)(profile->total / count));
+      logger_char('/');
+      logger_number(profile->max);
+      logger_string(" log2");
+      for (uint8_t bucket = 0; bucket < PROFILE_BUCKETS; bucket++) {
+        logger_char(' ');
+        logger_number(profile->histogram[bucket]);
+      }
+    }
+    logger_newline();
+  }
+
+  logger_set_policy(policy);
+}
+
+#endif // UTILS_PROFILE
@@ -0,0 +1,82 @@
+/**
+ * @file profile.h
+ * @brief Measure the number of cycles spent in code
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * Define UTILS_PROFILE to measure how many CPU cycles are spent between
+ * `PROFILE_ENTER(site)` and `PROFILE_EXIT(site)`:
+ *
+ *     PROFILE_ENTER(PROFILE_TX_PROCESS);
+ *     loconet_tx_process();
+ *     PROFILE_EXIT(PROFILE_TX_PROCESS);
+ *
+ * For every site the number of measurements, the minimum, mean and maximum
+ * number of cycles and a histogram are kept. Bucket n of the histogram
+ * counts the measurements of 2^n up to 2^(n+1) cycles, the last bucket
+ * also counts everything longer. `profile_dump()` writes them to the
+ * logger. Cycles are counted with `timer_cycles()`, so the timer has to
+ * be initialized.
+ *
+ * Without UTILS_PROFILE the macros are empty.
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#ifndef _UTILS_PROFILE_H_
+#define _UTILS_PROFILE_H_
+
+// Do we want profiling?
+#ifdef UTILS_PROFILE
+
+#include <stdint.h>
+#include "timer.h"
+
+//-----------------------------------------------------------------------------
+// Measured sites
+enum {
+  PROFILE_SERCOM,       // Loconet usart interrupt
+  PROFILE_EIC,          // External interrupt (flank detection)
+  PROFILE_FLANK_TIMER,  // Loconet flank timer interrupt
+  PROFILE_RX_PROCESS,   // Handling received messages
+  PROFILE_TX_PROCESS,   // Starting to send a message
+  PROFILE_FAST_CLOCK,   // Fast clock processing
+  PROFILE_SITES
+};
+
+#define PROFILE_BUCKETS 16
+
+typedef struct {
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t total;
+  uint16_t histogram[PROFILE_BUCKETS];
+} PROFILE_SITE_Type;
+
+extern volatile PROFILE_SITE_Type profile_sites[PROFILE_SITES];
+
+//-----------------------------------------------------------------------------
+#define PROFILE_ENTER(site) uint32_t profile_start_##site = timer_cycles()
+#define PROFILE_EXIT(site) profile_record(site, timer_cycles() - profile_start_##site)
+
+//-----------------------------------------------------------------------------
+// Add a measurement of a site
+extern void profile_record(uint8_t site, uint32_t cycles);
+// Clear all measurements
+extern void profile_reset(void);
+// Write the measurements to the logger
+extern void profile_dump(void);
+
+#else // UTILS_PROFILE
+
+#define PROFILE_ENTER(...) do {} while (0)
+#define PROFILE_EXIT(...) do {} while (0)
+#define profile_record(...) do {} while (0)
+#define profile_reset(...) do {} while (0)
+#define profile_dump(...) do {} while (0)
+
+#endif // UTILS_PROFILE
+
+#endif // _UTILS_PROFILE_H_
@@ -0,0 +1,129 @@
+/**
+ * @file ringbuffer.h
+ * @brief Single producer, single consumer ringbuffer
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * The ringbuffer can be shared between an interrupt and the main loop,
+ * as long as one side only writes and the other side only reads.
+ *
+ * The size of a ringbuffer has to be a power of two, so an index in the
+ * buffer is found by masking instead of dividing (the Cortex-M0+ has no
+ * hardware divider). The writer and reader are free running counters,
+ * their difference is the number of bytes in the ringbuffer.
+ *
+ * To define a ringbuffer use:
+ *
+ *     RINGBUFFER_BUILD(name, size);
+ *
+ * The producer can either push single bytes, or write bytes after the
+ * writer using `ringbuffer_at` and make them available at once using
+ * `ringbuffer_commit`. The consumer reads bytes with `ringbuffer_pop`,
+ * or reads them in place and frees them using `ringbuffer_release`.
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#ifndef _UTILS_RINGBUFFER_H_
+#define _UTILS_RINGBUFFER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+  uint8_t *buffer;
+  uint32_t mask;
+  volatile uint32_t writer;
+  volatile uint32_t reader;
+  uint32_t high_watermark;
+} RINGBUFFER_Type;
+
+#define RINGBUFFER_BUILD(name, size)                                          \
+  _Static_assert((size) > 0 && ((size) & ((size) - 1)) == 0,                  \
+    #name " size should be a power of two");                                  \
+  static uint8_t name##_buffer[size];                                         \
+  static RINGBUFFER_Type name = { name##_buffer, (size) - 1, 0, 0, 0 }
+
+// Make sure bytes are written/read before the writer/reader is changed
+#define RINGBUFFER_BARRIER() __asm volatile ("" ::: "memory")
+
+//-----------------------------------------------------------------------------
+// Total number of bytes the ringbuffer can hold
+static inline uint32_t ringbuffer_size(RINGBUFFER_Type *ringbuffer)
+{
+  return ringbuffer->mask + 1;
+}
+
+//-----------------------------------------------------------------------------
+// Number of bytes in the ringbuffer
+static inline uint32_t ringbuffer_used(RINGBUFFER_Type *ringbuffer)
+{
+  return ringbuffer->writer - ringbuffer->reader;
+}
+
+//-----------------------------------------------------------------------------
+// Number of bytes which can still be written
+static inline uint32_t ringbuffer_free(RINGBUFFER_Type *ringbuffer)
+{
+  return ringbuffer_size(ringbuffer) - ringbuffer_used(ringbuffer);
+}
+
+//-----------------------------------------------------------------------------
+static inline bool ringbuffer_is_empty(RINGBUFFER_Type *ringbuffer)
+{
+  return ringbuffer->writer == ringbuffer->reader;
+}
+
+//-----------------------------------------------------------------------------
+// Byte at a (free running) index
+static inline uint8_t *ringbuffer_at(RINGBUFFER_Type *ringbuffer, uint32_t index)
+{
+  return &ringbuffer->buffer[index & ringbuffer->mask];
+}
+
+//-----------------------------------------------------------------------------
+// Producer: make count bytes written after the writer available
+static inline void ringbuffer_commit(RINGBUFFER_Type *ringbuffer, uint32_t count)
+{
+  RINGBUFFER_BARRIER();
+  ringbuffer->writer += count;
+  uint32_t used = ringbuffer_used(ringbuffer);
+  if (used > ringbuffer->high_watermark) {
+    ringbuffer->high_watermark = used;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Producer: add a byte, returns false if the ringbuffer is full
+static inline bool ringbuffer_push(RINGBUFFER_Type *ringbuffer, uint8_t byte)
+{
+  if (!ringbuffer_free(ringbuffer)) {
+    return false;
+  }
+  *ringbuffer_at(ringbuffer, ringbuffer->writer) = byte;
+  ringbuffer_commit(ringbuffer, 1);
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+// Consumer: free count bytes after they have been read
+static inline void ringbuffer_release(RINGBUFFER_Type *ringbuffer, uint32_t count)
+{
+  RINGBUFFER_BARRIER();
+  ringbuffer->reader += count;
+}
+
+//-----------------------------------------------------------------------------
+// Consumer: take a byte, returns false if the ringbuffer is empty
+static inline bool ringbuffer_pop(RINGBUFFER_Type *ringbuffer, uint8_t *byte)
+{
+  if (ringbuffer_is_empty(ringbuffer)) {
+    return false;
+  }
+  *byte = *ringbuffer_at(ringbuffer, ringbuffer->reader);
+  ringbuffer_release(ringbuffer, 1);
+  return true;
+}
+
+#endif // _UTILS_RINGBUFFER_H_
@@ -0,0 +1,27 @@
+/**
+ * @file timer.c
+ * @brief Millisecond time base using the SysTick timer
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#include "samd20.h"
+#include "timer.h"
+
+volatile uint32_t timer_milliseconds = 0;
+
+//-----------------------------------------------------------------------------
+void timer_init(void)
+{
+  SysTick_Config(TIMER_TICKS_PER_MS);
+}
+
+//-----------------------------------------------------------------------------
+void irq_handler_sys_tick(void);
+void irq_handler_sys_tick(void)
+{
+  timer_milliseconds++;
+}
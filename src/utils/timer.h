@@ -0,0 +1,77 @@
+/**
+ * @file timer.h
+ * @brief Millisecond time base using the SysTick timer
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * The SysTick timer interrupts every millisecond and counts the
+ * milliseconds since `timer_init()` was called. Timeouts are checked by
+ * comparing against `timer_ms()`, e.g.:
+ *
+ *     uint32_t start = timer_ms();
+ *     ...
+ *     if (timer_elapsed(start) >= 500) {
+ *       // 500ms have passed
+ *     }
+ *
+ * The counter wraps after 49 days, `timer_elapsed` handles the wrap.
+ *
+ * For shorter durations `timer_cycles()` counts CPU cycles, using the
+ * milliseconds and the current value of the SysTick timer. It wraps after
+ * about 9 minutes (at 8MHz).
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#ifndef _UTILS_TIMER_H_
+#define _UTILS_TIMER_H_
+
+#include <stdint.h>
+#include "samd20.h"
+
+// SysTick ticks (CPU cycles) per millisecond
+#define TIMER_TICKS_PER_MS (F_CPU / 1000)
+
+//-----------------------------------------------------------------------------
+extern volatile uint32_t timer_milliseconds;
+
+//-----------------------------------------------------------------------------
+// Start the SysTick timer
+extern void timer_init(void);
+
+//-----------------------------------------------------------------------------
+// Milliseconds since timer_init
+static inline uint32_t timer_ms(void)
+{
+  return timer_milliseconds;
+}
+
+//-----------------------------------------------------------------------------
+// Milliseconds since start
+static inline uint32_t timer_elapsed(uint32_t start)
+{
+  return timer_milliseconds - start;
+}
+
+//-----------------------------------------------------------------------------
+// CPU cycles since timer_init
+static inline uint32_t timer_cycles(void)
+{
+  uint32_t ms;
+  uint32_t value;
+  uint32_t wrapped;
+  do {
+    ms = timer_milliseconds;
+    value = SysTick->VAL;
+    // SysTick wrapped, but its interrupt did not run yet (we are in an
+    // interrupt or interrupts are disabled)
+    wrapped = SCB->ICSR & SCB_ICSR_PENDSTSET_Msk;
+    if (wrapped) {
+      value = SysTick->VAL;
+    }
+  } while (ms != timer_milliseconds);
+  return (ms + (wrapped ? 1 : 0)) * TIMER_TICKS_PER_MS + (TIMER_TICKS_PER_MS - 1 - value);
+}
+
+#endif // _UTILS_TIMER_H_
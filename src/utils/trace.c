@@ -0,0 +1,112 @@
+/**
+ * @file trace.c
+ * @brief Record bus events in a ring of binary records
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#include "trace.h"
+
+// Do we want tracing?
+#ifdef UTILS_TRACE
+
+#include "logger.h"
+
+TRACE_RECORD_Type trace_records[TRACE_SIZE];
+volatile uint16_t trace_writer = 0;
+volatile uint8_t trace_full = 0;
+volatile uint8_t trace_paused = 0;
+
+//-----------------------------------------------------------------------------
+// Write a byte and add it to the checksum
+static void trace_dump_byte(uint8_t byte, uint8_t *checksum)
+{
+  logger_char(byte);
+  *checksum ^= byte;
+}
+
+static void trace_dump_uint16(uint16_t value, uint8_t *checksum)
+{
+  trace_dump_byte(value & 0xFF, checksum);
+  trace_dump_byte(value >> 8, checksum);
+}
+
+static void trace_dump_uint32(uint32_t value, uint8_t *checksum)
+{
+  trace_dump_uint16(value & 0xFFFF, checksum);
+  trace_dump_uint16(value >> 16, checksum);
+}
+
+//-----------------------------------------------------------------------------
+// Write a frame of count records, starting at first in records (masked)
+static void trace_dump_frame(const TRACE_RECORD_Type *records, uint16_t mask, uint16_t first, uint16_t count)
+{
+  // A dump does not fit in the logger, wait instead of dropping bytes
+  uint8_t policy = logger_set_policy(LOGGER_WAIT);
+  uint8_t checksum = 0;
+
+  logger_cstring("LNTR");
+  trace_dump_byte(TRACE_VERSION, &checksum);
+  trace_dump_byte(sizeof(TRACE_RECORD_Type), &checksum);
+  trace_dump_uint16(count, &checksum);
+  trace_dump_uint32(TIMER_TICKS_PER_MS, &checksum);
+
+  for (uint16_t index = first; index != (uint16_t)(first + count); index++) {
+    const TRACE_RECORD_Type *record = &records[index & mask];
+    trace_dump_uint32(record->time, &checksum);
+    trace_dump_byte(record->event, &checksum);
+    trace_dump_byte(record->opcode, &checksum);
+    trace_dump_byte(record->data[0], &checksum);
+    trace_dump_byte(record->data[1], &checksum);
+  }
+  logger_char(checksum);
+
+  logger_set_policy(policy);
+}
+
+//-----------------------------------------------------------------------------
+// Number of records in the ring
+static inline uint16_t trace_recorded(uint16_t writer)
+{
+  return trace_full ? TRACE_SIZE : writer;
+}
+
+//-----------------------------------------------------------------------------
+void trace_dump(void)
+{
+  trace_paused = 1;
+
+  // Oldest record first
+  uint16_t writer = trace_writer;
+  uint16_t count = trace_recorded(writer);
+  trace_dump_frame(trace_records, TRACE_SIZE - 1, writer - count, count);
+
+  trace_paused = 0;
+}
+
+//-----------------------------------------------------------------------------
+void trace_dump_records(const TRACE_RECORD_Type *records, uint16_t count)
+{
+  trace_dump_frame(records, 0xFFFF, 0, count);
+}
+
+//-----------------------------------------------------------------------------
+uint16_t trace_copy(TRACE_RECORD_Type *records, uint16_t count)
+{
+  uint16_t writer = trace_writer;
+  uint16_t recorded = trace_recorded(writer);
+  if (count > recorded) {
+    count = recorded;
+  }
+
+  // Oldest of the last count records first
+  for (uint16_t index = 0; index < count; index++) {
+    records[index] = trace_records[(writer - count + index) & (TRACE_SIZE - 1)];
+  }
+  return count;
+}
+
+#endif // UTILS_TRACE
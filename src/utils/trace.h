@@ -0,0 +1,121 @@
+/**
+ * @file trace.h
+ * @brief Record bus events in a ring of binary records
+ *
+ * \copyright Copyright 2017 /Dev. All rights reserved.
+ * \license This project is released under MIT license.
+ *
+ * Define UTILS_TRACE to record loconet events, e.g. received messages,
+ * collisions and the states of the flank timer. Recording an event only
+ * writes a record of 8 bytes in RAM, so it can be done from interrupts
+ * without changing the timing:
+ *
+ *     trace_event(TRACE_RX, opcode, length, valid);
+ *
+ * The ring holds the last TRACE_SIZE (default 64, has to be a power of two)
+ * records. `trace_dump()` writes them to the logger as a binary frame:
+ *
+ *     "LNTR"        magic
+ *     uint8_t       version (1)
+ *     uint8_t       size of a record (8)
+ *     uint16_t      number of records
+ *     uint32_t      cycles per millisecond
+ *     records       oldest first: uint32_t cycles, event, opcode, data[2]
+ *     uint8_t       xor of all bytes after the magic
+ *
+ * Multi-byte values are little endian. Use tools/trace_decode.py to turn a
+ * captured dump into a timeline.
+ *
+ * Without UTILS_TRACE the functions are empty.
+ *
+ * @author Ferdi van der Werf <ferdi@slashdev.nl>
+ */
+
+#ifndef _UTILS_TRACE_H_
+#define _UTILS_TRACE_H_
+
+// Do we want tracing?
+#ifdef UTILS_TRACE
+
+#include <stdint.h>
+#include "samd20.h"
+#include "timer.h"
+
+#ifndef TRACE_SIZE
+#define TRACE_SIZE 64
+#endif
+
+#define TRACE_VERSION 1
+
+//-----------------------------------------------------------------------------
+// Events, the meaning of opcode and data depends on the event
+enum {
+  TRACE_RX = 1,         // opcode, length, checksum valid
+  TRACE_TX_START,       // opcode, length, retries
+  TRACE_TX_END,         // opcode, length
+  TRACE_COLLISION,      // -, transmitting
+  TRACE_LINE_BREAK,     // -
+  TRACE_BUSY,           // - (first flank after idle)
+  TRACE_MASTER_DELAY,   // -
+  TRACE_PRIORITY_DELAY, // -, delay in bit times
+  TRACE_IDLE,           // -
+};
+
+typedef struct {
+  uint32_t time;    // timer_cycles()
+  uint8_t event;
+  uint8_t opcode;
+  uint8_t data[2];
+} TRACE_RECORD_Type;
+
+_Static_assert(TRACE_SIZE > 0 && (TRACE_SIZE & (TRACE_SIZE - 1)) == 0, "TRACE_SIZE should be a power of two");
+_Static_assert(sizeof(TRACE_RECORD_Type) == 8, "TRACE_RECORD_Type should be 8 bytes");
+
+extern TRACE_RECORD_Type trace_records[TRACE_SIZE];
+extern volatile uint16_t trace_writer;
+extern volatile uint8_t trace_full;
+extern volatile uint8_t trace_paused;
+
+//-----------------------------------------------------------------------------
+// Record an event, can be called from interrupts
+static inline void trace_event(uint8_t event, uint8_t opcode, uint8_t a, uint8_t b)
+{
+  if (trace_paused) {
+    return;
+  }
+  // Claim a record, an interrupt will claim the next one
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  uint16_t index = trace_writer++ & (TRACE_SIZE - 1);
+  // The writer wraps, remember that all records are used
+  if (index == TRACE_SIZE - 1) {
+    trace_full = 1;
+  }
+  __set_PRIMASK(primask);
+  TRACE_RECORD_Type *record = &trace_records[index];
+
+  record->time = timer_cycles();
+  record->event = event;
+  record->opcode = opcode;
+  record->data[0] = a;
+  record->data[1] = b;
+}
+
+//-----------------------------------------------------------------------------
+// Write the records to the logger, events are not recorded meanwhile
+extern void trace_dump(void);
+// Write records, e.g. from trace_copy, to the logger in the same format
+extern void trace_dump_records(const TRACE_RECORD_Type *records, uint16_t count);
+// Copy the last count records, oldest first, returns the number copied
+extern uint16_t trace_copy(TRACE_RECORD_Type *records, uint16_t count);
+
+#else // UTILS_TRACE
+
+#define trace_event(...) do {} while (0)
+#define trace_dump(...) do {} while (0)
+#define trace_dump_records(...) do {} while (0)
+#define trace_copy(...) 0
+
+#endif // UTILS_TRACE
+
+#endif // _UTILS_TRACE_H_
@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+"""Decode tokenised logger messages (see src/utils/logger.h).
+
+Messages logged with `logger_log` only send the id of their format and the
+arguments. The formats are read from the `.logger_formats` section of the
+elf file the chip runs. Use
+
+    tools/log_decode.py build/starter.elf < /dev/ttyUSB0
+
+to decode a live stream, or pass a captured file after the elf file. Text
+written with the other logger functions is passed through unchanged, trace
+dumps are skipped so the same capture can be passed to tools/trace_decode.py.
+"""
+
+import re
+import struct
+import sys
+
+SECTION = b".logger_formats"
+TOKEN = 0xFF
+# Trace dumps, decode these with tools/trace_decode.py
+TRACE_MAGIC = b"LNTR"
+TRACE_VERSION = 1
+TRACE_HEADER = struct.Struct("<BBHI")
+TRACE_RECORD_SIZE = 8
+CONVERSION = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)(?:hh|h|ll|l|z|t)?([diouxXcsp%])")
+
+
+def formats(path):
+    """Map the ids of the formats in the elf file to the formats."""
+    with open(path, "rb") as elf:
+        data = elf.read()
+    if data[:4] != b"\x7fELF":
+        raise ValueError("%s is not an elf file" % path)
+    is64 = data[4] == 2
+    endian = "<" if data[5] == 1 else ">"
+    if is64:
+        shoff, = struct.unpack_from(endian + "Q", data, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from(endian + "HHH", data, 0x3A)
+        header = struct.Struct(endian + "IIQQQQIIQQ")
+    else:
+        shoff, = struct.unpack_from(endian + "I", data, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from(endian + "HHH", data, 0x2E)
+        header = struct.Struct(endian + "IIIIIIIIII")
+    sections = [header.unpack_from(data, shoff + index * shentsize) for index in range(shnum)]
+    names = sections[shstrndx]
+    for section in sections:
+        name = data[names[4] + section[0]:data.index(b"\0", names[4] + section[0])]
+        if name != SECTION:
+            continue
+        address, offset, size = section[3], section[4], section[5]
+        contents = data[offset:offset + size]
+        # Formats are separate strings, possibly with padding between them
+        result = {}
+        start = 0
+        while start < len(contents):
+            if contents[start] == 0:
+                start += 1
+                continue
+            end = contents.index(b"\0", start)
+            result[(address + start) & 0xFFFF] = contents[start:end].decode("latin-1")
+            start = end + 1
+        return result
+    raise ValueError("%s has no %s section" % (path, SECTION.decode()))
+
+
+def render(fmt, args):
+    """Format like printf, arguments are 32 bits words."""
+    args = list(args)
+
+    def convert(match):
+        flags, kind = match.groups()
+        if kind == "%":
+            return "%"
+        if not args:
+            return "<missing>"
+        value = args.pop(0)
+        if kind in "di" and value & 0x80000000:
+            value -= 1 << 32
+        if kind in "sp":
+            # Strings can't be sent, show their address
+            return "0x%08X" % value
+        if kind == "c":
+            value = chr(value & 0xFF)
+        return ("%" + flags + kind) % value
+
+    return CONVERSION.sub(convert, fmt)
+
+
+def trace_frame(buffer):
+    """Length of the trace dump at the start of buffer, 0 if it is not
+    complete yet or None if it is no trace dump (see tools/trace_decode.py).
+    """
+    offset = len(TRACE_MAGIC)
+    if len(buffer) < offset + TRACE_HEADER.size:
+        return 0
+    version, size, count, _ = TRACE_HEADER.unpack_from(buffer, offset)
+    if version != TRACE_VERSION or size != TRACE_RECORD_SIZE:
+        return None
+    length = offset + TRACE_HEADER.size + count * size + 1
+    return length if len(buffer) >= length else 0
+
+
+def decode(stream, table, out):
+    """Copy text from the stream to out and replace tokenised messages. Trace
+    dumps are binary and may contain the token marker, they are skipped.
+    """
+    buffer = b""
+    while True:
+        chunk = stream.read1(256) if hasattr(stream, "read1") else stream.read(256)
+        if not chunk:
+            break
+        buffer += chunk
+        while buffer:
+            markers = [index for index in (buffer.find(bytes([TOKEN])), buffer.find(TRACE_MAGIC))
+                       if index >= 0]
+            marker = min(markers) if markers else -1
+            if marker != 0:
+                text = buffer if marker < 0 else buffer[:marker]
+                if marker < 0:
+                    # Keep the start of a trace dump which is not complete yet
+                    for keep in range(len(TRACE_MAGIC) - 1, 0, -1):
+                        if text.endswith(TRACE_MAGIC[:keep]):
+                            text = text[:-keep]
+                            break
+                    if not text:
+                        break
+                out.write(text.decode("latin-1"))
+                buffer = buffer[len(text):]
+                continue
+            if buffer.startswith(TRACE_MAGIC):
+                length = trace_frame(buffer)
+                if length is None:
+                    out.write(TRACE_MAGIC.decode("latin-1"))
+                    buffer = buffer[len(TRACE_MAGIC):]
+                    continue
+                if not length:
+                    break
+                count = TRACE_HEADER.unpack_from(buffer, len(TRACE_MAGIC))[2]
+                out.write("<trace dump of %d records>\n" % count)
+                buffer = buffer[length:]
+                continue
+            if len(buffer) < 4:
+                break
+            id, count = struct.unpack_from("<HB", buffer, 1)
+            if len(buffer) < 4 + 4 * count:
+                break
+            args = struct.unpack_from("<%dI" % count, buffer, 4)
+            buffer = buffer[4 + 4 * count:]
+            fmt = table.get(id)
+            if fmt is None:
+                out.write("<unknown message %04X %s>\n" % (id, " ".join("%X" % arg for arg in args)))
+            else:
+                out.write(render(fmt, args) + "\n")
+        out.flush()
+    # Text which looked like the start of a trace dump
+    if buffer and TRACE_MAGIC.startswith(buffer):
+        out.write(buffer.decode("latin-1"))
+        out.flush()
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        print("usage: %s elf [capture]" % sys.argv[0], file=sys.stderr)
+        return 2
+    table = formats(sys.argv[1])
+    if len(sys.argv) == 3:
+        with open(sys.argv[2], "rb") as stream:
+            decode(stream, table, sys.stdout)
+    else:
+        decode(sys.stdin.buffer, table, sys.stdout)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
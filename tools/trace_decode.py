@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+"""Decode loconet trace dumps (see src/utils/trace.h) into timelines.
+
+Capture the output of the logger while `trace_dump()` is called, e.g.
+
+    cat /dev/ttyUSB0 > dump.bin
+
+and decode it with
+
+    tools/trace_decode.py dump.bin
+
+The capture may contain other logger output, every frame found is decoded.
+"""
+
+import struct
+import sys
+
+MAGIC = b"LNTR"
+VERSION = 1
+HEADER = struct.Struct("<BBHI")
+RECORD = struct.Struct("<IBBBB")
+
+EVENTS = {
+    1: "RX",
+    2: "TX start",
+    3: "TX end",
+    4: "collision",
+    5: "line break",
+    6: "busy",
+    7: "master delay",
+    8: "priority delay",
+    9: "idle",
+}
+
+
+def describe(event, opcode, a, b):
+    """Text for the opcode and data of an event."""
+    if event == 1:
+        return "%02X length %d%s" % (opcode, a, "" if b else " invalid checksum")
+    if event == 2:
+        return "%02X length %d retries %d" % (opcode, a, b)
+    if event == 3:
+        return "%02X length %d" % (opcode, a)
+    if event == 4:
+        return "while transmitting" if a else ""
+    if event == 8:
+        return "%d bit times" % a
+    return ""
+
+
+def frames(data):
+    """Yield (cycles per ms, records) for every valid frame in data."""
+    start = data.find(MAGIC)
+    while start >= 0:
+        offset = start + len(MAGIC)
+        if offset + HEADER.size <= len(data):
+            version, size, count, cycles_per_ms = HEADER.unpack_from(data, offset)
+            end = offset + HEADER.size + count * size
+            if version == VERSION and size == RECORD.size and end < len(data):
+                checksum = 0
+                for byte in data[offset:end]:
+                    checksum ^= byte
+                if checksum == data[end]:
+                    records = [RECORD.unpack_from(data, offset + HEADER.size + index * size)
+                               for index in range(count)]
+                    yield cycles_per_ms, records
+                    start = data.find(MAGIC, end + 1)
+                    continue
+                print("Skipping frame at %d: invalid checksum" % start, file=sys.stderr)
+        start = data.find(MAGIC, start + 1)
+
+
+def timeline(cycles_per_ms, records):
+    """Print records with the time since the first record."""
+    if not records:
+        print("(no records)")
+        return
+    first = records[0][0]
+    previous = first
+    for time, event, opcode, a, b in records:
+        # The cycle counter is 32 bits and wraps around
+        since_first = ((time - first) & 0xFFFFFFFF) / cycles_per_ms
+        since_previous = ((time - previous) & 0xFFFFFFFF) * 1000 / cycles_per_ms
+        previous = time
+        name = EVENTS.get(event, "event %d" % event)
+        print("%12.3f ms %+10.0f us  %-15s %s" % (since_first, since_previous, name,
+                                                   describe(event, opcode, a, b)))
+
+
+def main():
+    if len(sys.argv) > 2:
+        print("usage: %s [dump]" % sys.argv[0], file=sys.stderr)
+        return 2
+    if len(sys.argv) == 2:
+        with open(sys.argv[1], "rb") as dump:
+            data = dump.read()
+    else:
+        data = sys.stdin.buffer.read()
+
+    found = 0
+    for cycles_per_ms, records in frames(data):
+        found += 1
+        print("Trace %d: %d records" % (found, len(records)))
+        timeline(cycles_per_ms, records)
+    if not found:
+        print("No trace found", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())